@@ -0,0 +1,126 @@
+// Benchmark serial vs parallel extractZip() on a runtime archive.
+// Usage: ./bench_extract <runtime.zip> [threads] [iterations]
+#define RVM_CPP_NO_MAIN
+#include "main.cpp"
+
+#include <chrono>
+#include <map>
+#include <ftw.h>
+
+// Relative path -> (size, crc32) for every regular file under a directory
+static std::map<std::string, std::pair<off_t, uLong>>* treeSummary = nullptr;
+static size_t treeRootLength = 0;
+
+static int summarizeFile(const char* path, const struct stat* sb, int type, struct FTW*) {
+    if (type != FTW_F) return 0;
+    
+    uLong crc = crc32(0L, Z_NULL, 0);
+    FILE* f = fopen(path, "rb");
+    if (f) {
+        char buf[65536];
+        size_t n;
+        while ((n = fread(buf, 1, sizeof(buf), f)) > 0) {
+            crc = crc32(crc, (const Bytef*)buf, n);
+        }
+        fclose(f);
+    }
+    (*treeSummary)[std::string(path).substr(treeRootLength)] = {sb->st_size, crc};
+    return 0;
+}
+
+static std::map<std::string, std::pair<off_t, uLong>> summarizeTree(const std::string& root) {
+    std::map<std::string, std::pair<off_t, uLong>> summary;
+    treeSummary = &summary;
+    treeRootLength = root.size();
+    nftw(root.c_str(), summarizeFile, 64, FTW_PHYS);
+    return summary;
+}
+
+static int removeEntry(const char* path, const struct stat*, int, struct FTW*) {
+    return remove(path);
+}
+
+static void removeTree(const std::string& root) {
+    nftw(root.c_str(), removeEntry, 64, FTW_DEPTH | FTW_PHYS);
+}
+
+static std::string makeTempDir() {
+    char templ[] = "/tmp/rvm-bench-extract-XXXXXX";
+    if (!mkdtemp(templ)) {
+        throw std::runtime_error("Failed to create temporary directory");
+    }
+    return templ;
+}
+
+// Extract once into a fresh directory and return elapsed seconds
+static double timeExtract(const std::string& zipPath, const std::string& dir, int threads) {
+    auto start = std::chrono::steady_clock::now();
+    extractZip(zipPath, dir, threads);
+    auto end = std::chrono::steady_clock::now();
+    return std::chrono::duration<double>(end - start).count();
+}
+
+int main(int argc, char* argv[]) {
+    if (argc < 2) {
+        std::cerr << "Usage: " << argv[0] << " <runtime.zip> [threads] [iterations]" << std::endl;
+        return 1;
+    }
+    
+    std::string zipPath = argv[1];
+    int threads = argc > 2 ? std::stoi(argv[2]) : (int)std::max(1u, std::thread::hardware_concurrency());
+    int iterations = argc > 3 ? std::stoi(argv[3]) : 3;
+    
+    struct stat st;
+    if (stat(zipPath.c_str(), &st) != 0) {
+        std::cerr << "Archive not found: " << zipPath << std::endl;
+        return 1;
+    }
+    
+    std::cout << "Archive: " << zipPath << " (" << st.st_size / (1024 * 1024) << " MB)" << std::endl;
+    std::cout << "Parallel threads: " << threads << ", iterations: " << iterations << std::endl;
+    
+    double serialTotal = 0;
+    double parallelTotal = 0;
+    bool identical = true;
+    
+    try {
+        for (int i = 0; i < iterations; i++) {
+            std::string serialDir = makeTempDir();
+            std::string parallelDir = makeTempDir();
+            
+            double serial = timeExtract(zipPath, serialDir, 1);
+            double parallel = timeExtract(zipPath, parallelDir, threads);
+            serialTotal += serial;
+            parallelTotal += parallel;
+            
+            std::cout << "[" << i + 1 << "] serial " << std::fixed << std::setprecision(3) << serial
+                      << "s, parallel " << parallel << "s" << std::endl;
+            
+            if (summarizeTree(serialDir) != summarizeTree(parallelDir)) {
+                identical = false;
+            }
+            
+            removeTree(serialDir);
+            removeTree(parallelDir);
+        }
+    } catch (const std::exception& e) {
+        std::cerr << "Benchmark failed: " << e.what() << std::endl;
+        return 1;
+    }
+    
+    double serialAvg = serialTotal / iterations;
+    double parallelAvg = parallelTotal / iterations;
+    
+    std::cout << std::endl;
+    std::cout << "Serial average:   " << std::fixed << std::setprecision(3) << serialAvg << "s" << std::endl;
+    std::cout << "Parallel average: " << parallelAvg << "s" << std::endl;
+    std::cout << "Speedup:          " << std::setprecision(2) << serialAvg / parallelAvg << "x" << std::endl;
+    
+    if (!identical) {
+        std::cout << "✗ Serial and parallel extraction produced different trees" << std::endl;
+        return 1;
+    }
+    std::cout << "✓ Serial and parallel extraction produced identical trees" << std::endl;
+    
+    return 0;
+}
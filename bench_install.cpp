@@ -0,0 +1,454 @@
+// Benchmark the install path against a local HTTP stand-in for the CDN.
+// Generates synthetic manifests and a runtime-shaped archive (thousands of files of
+// mixed sizes and compressibility), serves them with http_standin, then times manifest
+// fetch and revalidation, the archive download, extraction, file and streaming
+// installs, and an end-to-end fetch + install. Results are printed as JSON.
+//
+// Usage: ./bench_install [--files=3000] [--size-mb=150] [--manifests=20] [--iterations=3]
+//                        [--extract-threads=0] [--download-connections=4]
+//                        [--throttle=<bytes/sec>] [--output=<file>]
+#define RVM_CPP_NO_MAIN
+#include "main.cpp"
+#define HTTP_STANDIN_NO_MAIN
+#include "http_standin.cpp"
+
+#include <chrono>
+#include <ftw.h>
+
+const std::string BENCH_RUNTIME_VERSION = "99.0.0.1";
+
+struct BenchOptions {
+    int files = 3000;
+    uint64_t sizeMb = 150;
+    int manifests = 20;
+    int iterations = 3;
+    int extractThreads = 0;
+    int downloadConnections = 4;
+    long throttle = 0;
+    std::string output;
+};
+
+// One file of the synthetic runtime
+struct SyntheticEntry {
+    std::string name;
+    uint64_t size;
+    bool executable;
+    // Random bytes rather than text
+    bool incompressible;
+};
+
+// Shape of a runtime: a few large binaries, tens of locale packs and thousands of
+// small resources, scaled so the total is roughly totalBytes
+static std::vector<SyntheticEntry> runtimeLayout(int files, uint64_t totalBytes) {
+    std::vector<SyntheticEntry> entries;
+    entries.push_back({"openfin", totalBytes * 30 / 100, true, true});
+    entries.push_back({"libffmpeg.so", totalBytes * 5 / 100, false, true});
+    entries.push_back({"chrome_crashpad_handler", totalBytes * 3 / 100, true, true});
+    entries.push_back({"resources.pak", totalBytes * 12 / 100, false, false});
+    entries.push_back({"icudtl.dat", totalBytes * 6 / 100, false, false});
+
+    int locales = std::min(60, std::max(1, files / 50));
+    for (int i = 0; i < locales; i++) {
+        entries.push_back({"locales/locale-" + std::to_string(i) + ".pak", totalBytes * 14 / 100 / locales, false, false});
+    }
+
+    // The rest share what is left, from tiny to a few hundred KB
+    int small = std::max(0, files - (int)entries.size());
+    uint64_t remaining = totalBytes * 30 / 100;
+    uint32_t random = 2463534242u;
+    std::vector<uint64_t> weights;
+    uint64_t weightSum = 0;
+    for (int i = 0; i < small; i++) {
+        random ^= random << 13;
+        random ^= random >> 17;
+        random ^= random << 5;
+        uint64_t weight = 1 + (random % 1000) * (random % 1000) / 100;
+        weights.push_back(weight);
+        weightSum += weight;
+    }
+    for (int i = 0; i < small; i++) {
+        std::string dir = "resources/" + std::to_string(i % 40) + "/";
+        entries.push_back({dir + "file-" + std::to_string(i) + (i % 3 == 0 ? ".so" : ".js"),
+                           remaining * weights[i] / std::max<uint64_t>(1, weightSum), false, i % 3 == 0});
+    }
+    return entries;
+}
+
+// Deterministic pools that file contents are sliced from
+static std::string makePool(size_t size, bool incompressible) {
+    static const char* words[] = {"function", "return", "const", "window", "document", "element",
+                                  "openfin", "runtime", "value", "object", "render", "context"};
+    std::string pool;
+    pool.reserve(size);
+    uint64_t random = 88172645463325252ull;
+    while (pool.size() < size) {
+        random ^= random << 13;
+        random ^= random >> 7;
+        random ^= random << 17;
+        if (incompressible) {
+            pool.append((const char*)&random, sizeof(random));
+        } else {
+            pool += words[random % 12];
+            pool += (random >> 8) % 5 == 0 ? "\n" : " ";
+        }
+    }
+    pool.resize(size);
+    return pool;
+}
+
+static void put16(std::string& out, uint16_t v) {
+    out += (char)(v & 0xff);
+    out += (char)(v >> 8);
+}
+
+static void put32(std::string& out, uint32_t v) {
+    put16(out, v & 0xffff);
+    put16(out, v >> 16);
+}
+
+// Write entries as a zip archive with sizes and CRCs in every local header (so it
+// can be streamed) and Unix modes in the central directory. Returns archive size.
+static uint64_t writeSyntheticZip(const std::string& path, const std::vector<SyntheticEntry>& entries) {
+    uint64_t largest = 0;
+    for (const auto& entry : entries) largest = std::max(largest, entry.size);
+    std::string randomPool = makePool(largest * 2 + 1, true);
+    std::string textPool = makePool(largest * 2 + 1, false);
+
+    FILE* out = fopen(path.c_str(), "wb");
+    if (!out) throw std::runtime_error("Failed to create " + path);
+
+    std::string central;
+    uint64_t offset = 0;
+    std::vector<unsigned char> compressed;
+    for (size_t i = 0; i < entries.size(); i++) {
+        const SyntheticEntry& entry = entries[i];
+        const std::string& pool = entry.incompressible ? randomPool : textPool;
+        const char* data = pool.data() + (i * 7919) % (largest + 1);
+
+        uint32_t crc = crc32(0L, (const Bytef*)data, entry.size);
+        z_stream zs;
+        memset(&zs, 0, sizeof(zs));
+        deflateInit2(&zs, Z_DEFAULT_COMPRESSION, Z_DEFLATED, -MAX_WBITS, 8, Z_DEFAULT_STRATEGY);
+        compressed.resize(deflateBound(&zs, entry.size));
+        zs.next_in = (Bytef*)data;
+        zs.avail_in = entry.size;
+        zs.next_out = compressed.data();
+        zs.avail_out = compressed.size();
+        deflate(&zs, Z_FINISH);
+        uint64_t compressedSize = zs.total_out;
+        deflateEnd(&zs);
+
+        uint16_t method = 8;
+        const char* body = (const char*)compressed.data();
+        if (compressedSize >= entry.size) {
+            method = 0;
+            body = data;
+            compressedSize = entry.size;
+        }
+
+        std::string header;
+        put32(header, 0x04034b50);
+        put16(header, 20);
+        put16(header, 0);
+        put16(header, method);
+        put16(header, 0);
+        put16(header, 0x21);
+        put32(header, crc);
+        put32(header, compressedSize);
+        put32(header, entry.size);
+        put16(header, entry.name.size());
+        put16(header, 0);
+        header += entry.name;
+        fwrite(header.data(), 1, header.size(), out);
+        fwrite(body, 1, compressedSize, out);
+
+        put32(central, 0x02014b50);
+        put16(central, (3 << 8) | 20);
+        put16(central, 20);
+        put16(central, 0);
+        put16(central, method);
+        put16(central, 0);
+        put16(central, 0x21);
+        put32(central, crc);
+        put32(central, compressedSize);
+        put32(central, entry.size);
+        put16(central, entry.name.size());
+        put16(central, 0);
+        put16(central, 0);
+        put16(central, 0);
+        put16(central, 0);
+        put32(central, (uint32_t)(0100000 | (entry.executable ? 0755 : 0644)) << 16);
+        put32(central, offset);
+        central += entry.name;
+
+        offset += header.size() + compressedSize;
+    }
+
+    std::string end;
+    put32(end, 0x06054b50);
+    put16(end, 0);
+    put16(end, 0);
+    put16(end, entries.size());
+    put16(end, entries.size());
+    put32(end, central.size());
+    put32(end, offset);
+    put16(end, 0);
+    fwrite(central.data(), 1, central.size(), out);
+    fwrite(end.data(), 1, end.size(), out);
+
+    bool ok = fflush(out) == 0;
+    fclose(out);
+    if (!ok) throw std::runtime_error("Failed to write " + path);
+    return offset + central.size() + end.size();
+}
+
+static int removeEntry(const char* path, const struct stat*, int, struct FTW*) {
+    return remove(path);
+}
+
+static void removeTree(const std::string& root) {
+    nftw(root.c_str(), removeEntry, 64, FTW_DEPTH | FTW_PHYS);
+}
+
+// Timings of one phase across iterations, or the error that stopped it
+struct PhaseResult {
+    std::vector<double> seconds;
+    uint64_t bytes = 0;
+    std::string error;
+
+    json toJson() const {
+        json result;
+        if (!error.empty()) result["error"] = error;
+        if (seconds.empty()) return result;
+        double sum = 0;
+        for (double s : seconds) sum += s;
+        double mean = sum / seconds.size();
+        result["seconds"] = seconds;
+        result["min"] = *std::min_element(seconds.begin(), seconds.end());
+        result["mean"] = mean;
+        result["max"] = *std::max_element(seconds.begin(), seconds.end());
+        if (bytes > 0) {
+            result["bytes"] = bytes;
+            result["bytes_per_sec"] = bytes / mean;
+        }
+        return result;
+    }
+};
+
+// Run step iterations times; setup and cleanup run untimed around each one
+template <typename Setup, typename Step, typename Cleanup>
+static PhaseResult runPhase(const std::string& name, int iterations, Setup setup, Step step, Cleanup cleanup) {
+    PhaseResult result;
+    for (int i = 0; i < iterations; i++) {
+        try {
+            setup();
+            auto start = std::chrono::steady_clock::now();
+            step();
+            result.seconds.push_back(std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count());
+            cleanup();
+        } catch (const std::exception& e) {
+            result.error = e.what();
+            cleanup();
+            break;
+        }
+    }
+    std::cerr << name << ": " << (result.error.empty() ? "done" : "failed (" + result.error + ")") << std::endl;
+    return result;
+}
+
+static void checkFetched(const std::vector<FetchResult>& results) {
+    for (const auto& result : results) {
+        if (!result.ok) throw std::runtime_error(result.url + ": " + result.error);
+        if (result.config.version != BENCH_RUNTIME_VERSION) throw std::runtime_error(result.url + ": wrong version");
+    }
+}
+
+static void checkInstalled(const std::string& dir) {
+    if (!fileExists(dir + "/openfin")) throw std::runtime_error("openfin missing after install");
+}
+
+int main(int argc, char* argv[]) {
+    BenchOptions options;
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg.find("--files=") == 0) {
+            options.files = std::stoi(arg.substr(8));
+        } else if (arg.find("--size-mb=") == 0) {
+            options.sizeMb = std::stoull(arg.substr(10));
+        } else if (arg.find("--manifests=") == 0) {
+            options.manifests = std::max(1, std::stoi(arg.substr(12)));
+        } else if (arg.find("--iterations=") == 0) {
+            options.iterations = std::max(1, std::stoi(arg.substr(13)));
+        } else if (arg.find("--extract-threads=") == 0) {
+            options.extractThreads = std::stoi(arg.substr(18));
+        } else if (arg.find("--download-connections=") == 0) {
+            options.downloadConnections = std::stoi(arg.substr(23));
+        } else if (arg.find("--throttle=") == 0) {
+            options.throttle = std::stol(arg.substr(11));
+        } else if (arg.find("--output=") == 0) {
+            options.output = arg.substr(9);
+        } else {
+            std::cerr << "Usage: " << argv[0] << " [--files=<n>] [--size-mb=<n>] [--manifests=<n>] [--iterations=<n>]"
+                      << " [--extract-threads=<n>] [--download-connections=<n>] [--throttle=<bytes/sec>]"
+                      << " [--output=<file>]" << std::endl;
+            return 1;
+        }
+    }
+
+    curl_global_init(CURL_GLOBAL_ALL);
+    LogOptions logOptions;
+    logOptions.level = LOG_WARN;
+    Logger::instance().configure(logOptions);
+
+    char templ[] = "/tmp/rvm-bench-install-XXXXXX";
+    if (!mkdtemp(templ)) {
+        std::cerr << "Failed to create temporary directory" << std::endl;
+        return 1;
+    }
+    std::string work = templ;
+    std::string root = work + "/cdn";
+    std::string runtimeDir = work + "/runtimes";
+    std::string archiveRel = "/runtime/" + getCPUArch() + "/" + BENCH_RUNTIME_VERSION;
+
+    json report;
+    try {
+        createDirectory(root + "/runtime/" + getCPUArch());
+        createDirectory(runtimeDir);
+
+        std::cerr << "Generating synthetic runtime..." << std::endl;
+        auto entries = runtimeLayout(options.files, options.sizeMb * 1024 * 1024);
+        uint64_t unpacked = 0;
+        for (const auto& entry : entries) unpacked += entry.size;
+        uint64_t archiveSize = writeSyntheticZip(root + archiveRel, entries);
+
+        for (int i = 0; i < options.manifests; i++) {
+            json manifest = {
+                {"runtime", {{"version", BENCH_RUNTIME_VERSION}, {"arguments", ""}}},
+                {"startup_app", {{"name", "bench-app-" + std::to_string(i)},
+                                 {"uuid", "bench-app-" + std::to_string(i)},
+                                 {"url", "http://127.0.0.1/app-" + std::to_string(i) + ".html"}}}
+            };
+            std::ofstream(root + "/app-" + std::to_string(i) + ".json") << manifest.dump(2);
+        }
+
+        StandinOptions standin;
+        standin.root = root;
+        standin.throttle = options.throttle;
+        standin.quiet = true;
+        int port = 0;
+        int listenFd = openStandinListener(0, &port);
+        if (listenFd < 0) throw std::runtime_error("Failed to start HTTP stand-in");
+        static StandinStats stats;
+        std::thread(serveStandin, listenFd, standin, &stats).detach();
+
+        std::string base = "http://127.0.0.1:" + std::to_string(port);
+        std::vector<std::string> urls;
+        for (int i = 0; i < options.manifests; i++) {
+            urls.push_back(base + "/app-" + std::to_string(i) + ".json");
+        }
+        std::string archiveURL = base + archiveRel;
+        std::string archivePath = work + "/archive.zip";
+        std::string extractDir = work + "/extract";
+        std::string targetDir = runtimeDir + "/" + BENCH_RUNTIME_VERSION;
+        auto none = []() {};
+
+        InstallOptions fileInstall;
+        fileInstall.extractThreads = options.extractThreads;
+        fileInstall.downloadConnections = options.downloadConnections;
+        fileInstall.downloadDir = runtimeDir + "/.downloads";
+        InstallOptions streamInstall = fileInstall;
+        streamInstall.streaming = true;
+        auto clearInstall = [&]() {
+            removeTree(targetDir);
+            removeTree(fileInstall.downloadDir);
+        };
+
+        FetchOptions uncached;
+        FetchOptions cached;
+        cached.cacheDir = work + "/manifest-cache";
+        fetchConfigs(urls, cached);
+
+        json phases;
+        phases["manifest_fetch"] = runPhase("manifest_fetch", options.iterations, none,
+            [&]() { checkFetched(fetchConfigs(urls, uncached)); }, none).toJson();
+        phases["manifest_revalidate"] = runPhase("manifest_revalidate", options.iterations, none,
+            [&]() { checkFetched(fetchConfigs(urls, cached)); }, none).toJson();
+
+        PhaseResult download = runPhase("download", options.iterations, none,
+            [&]() { downloadArchive(archiveURL, archivePath, options.downloadConnections); },
+            [&]() { unlink((archivePath + ".state").c_str()); });
+        download.bytes = archiveSize;
+        phases["download"] = download.toJson();
+
+        PhaseResult extract = runPhase("extract", options.iterations,
+            [&]() {
+                if (!fileExists(archivePath)) downloadArchive(archiveURL, archivePath, options.downloadConnections);
+                createDirectory(extractDir);
+            },
+            [&]() { extractZip(archivePath, extractDir, options.extractThreads); checkInstalled(extractDir); },
+            [&]() { removeTree(extractDir); });
+        extract.bytes = unpacked;
+        phases["extract"] = extract.toJson();
+        unlink(archivePath.c_str());
+
+        phases["install_file"] = runPhase("install_file", options.iterations, clearInstall,
+            [&]() { downloadAndExtractRuntime(archiveURL, targetDir, fileInstall); checkInstalled(targetDir); },
+            clearInstall).toJson();
+        phases["install_stream"] = runPhase("install_stream", options.iterations, clearInstall,
+            [&]() { downloadAndExtractRuntime(archiveURL, targetDir, streamInstall); checkInstalled(targetDir); },
+            clearInstall).toJson();
+
+        // What a cold start does for one app: fetch its manifest, then install its runtime
+        phases["end_to_end"] = runPhase("end_to_end", options.iterations, clearInstall,
+            [&]() {
+                auto fetched = fetchConfigs({urls[0]}, uncached);
+                checkFetched(fetched);
+                std::string dir = runtimeDir + "/" + fetched[0].config.version;
+                downloadAndExtractRuntime(base + "/runtime/" + getCPUArch() + "/" + fetched[0].config.version, dir,
+                                          fileInstall);
+                checkInstalled(dir);
+            },
+            clearInstall).toJson();
+
+        report = {
+            {"timestamp", (long)std::time(nullptr)},
+            {"archive", {
+                {"files", entries.size()},
+                {"bytes", archiveSize},
+                {"unpacked_bytes", unpacked}
+            }},
+            {"options", {
+                {"manifests", options.manifests},
+                {"iterations", options.iterations},
+                {"extract_threads", options.extractThreads},
+                {"download_connections", options.downloadConnections},
+                {"throttle", options.throttle}
+            }},
+            {"http", {
+                {"requests", stats.requests.load()},
+                {"bytes_sent", stats.bytesSent.load()},
+                {"not_modified", stats.notModified.load()}
+            }},
+            {"phases", phases}
+        };
+    } catch (const std::exception& e) {
+        std::cerr << "Benchmark failed: " << e.what() << std::endl;
+        removeTree(work);
+        return 1;
+    }
+
+    removeTree(work);
+
+    std::string text = report.dump(2);
+    if (options.output.empty()) {
+        std::cout << text << std::endl;
+    } else {
+        std::ofstream(options.output) << text << std::endl;
+    }
+
+    bool failed = false;
+    for (const auto& phase : report["phases"]) {
+        if (phase.contains("error")) failed = true;
+    }
+    return failed ? 1 : 0;
+}
@@ -0,0 +1,102 @@
+// Benchmark routing a runtime message with scanMessageRoute() vs a full json::parse().
+// Usage: ./bench_message [iterations]
+#define RVM_CPP_NO_MAIN
+#include "main.cpp"
+
+#include <chrono>
+
+// A get-desktop-owner-settings message whose payload carries roughly bodySize bytes
+// of application data, serialized the way runtimes send it (keys sorted)
+static std::string makeMessage(size_t bodySize) {
+    json entries = json::array();
+    size_t size = 0;
+    for (int i = 0; size < bodySize; i++) {
+        json entry = {
+            {"uuid", "app-" + std::to_string(i)},
+            {"name", "Application \"" + std::to_string(i) + "\""},
+            {"url", "https://example.com/apps/" + std::to_string(i) + "/index.html"},
+            {"autoShow", i % 2 == 0},
+            {"bounds", {{"x", i * 10}, {"y", i * 5}, {"width", 800}, {"height", 600}}},
+            {"tags", {"alpha", "beta", "gamma"}}
+        };
+        size += entry.dump().size();
+        entries.push_back(entry);
+    }
+
+    json message = {
+        {"messageId", "6f1c2a8e-4b7d-4e0a-9c3f-2d5b8a1e7f90"},
+        {"topic", "application"},
+        {"payload", {
+            {"action", "get-desktop-owner-settings"},
+            {"sourceUrl", "https://example.com/app.json"},
+            {"applications", entries}
+        }}
+    };
+    return "/tmp/runtime-socket:S:" + message.dump();
+}
+
+// Average seconds per call of route() over iterations
+template <typename Route>
+static double timeRoute(const std::string& message, int iterations, Route route) {
+    size_t pos = message.find(":S:") + 3;
+    const char* body = message.data() + pos;
+    size_t len = message.size() - pos;
+
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < iterations; i++) {
+        route(body, len);
+    }
+    auto end = std::chrono::steady_clock::now();
+    return std::chrono::duration<double>(end - start).count() / iterations;
+}
+
+int main(int argc, char* argv[]) {
+    int iterations = argc > 1 ? std::stoi(argv[1]) : 2000;
+    const size_t sizes[] = {0, 1024, 16 * 1024, 256 * 1024, 1024 * 1024};
+
+    std::cout << "Iterations per size: " << iterations << std::endl;
+    std::cout << std::endl;
+    std::cout << std::setw(12) << "message" << std::setw(14) << "full parse" << std::setw(14) << "scan"
+              << std::setw(10) << "speedup" << std::endl;
+
+    bool identical = true;
+    for (size_t bodySize : sizes) {
+        std::string message = makeMessage(bodySize);
+        // Larger messages get fewer iterations so each size takes similar time
+        int rounds = std::max(10, (int)(iterations / (1 + message.size() / 4096)));
+
+        size_t pos = message.find(":S:") + 3;
+        MessageRoute scanned;
+        bool ok = scanMessageRoute(message.data() + pos, message.size() - pos, scanned);
+        MessageRoute parsed = parseMessageRoute(message.data() + pos, message.size() - pos);
+        if (!ok || scanned.topic != parsed.topic || scanned.messageId != parsed.messageId ||
+            scanned.action != parsed.action) {
+            identical = false;
+        }
+
+        double full = timeRoute(message, rounds, [](const char* body, size_t len) {
+            MessageRoute route = parseMessageRoute(body, len);
+            (void)route;
+        });
+        double scan = timeRoute(message, rounds, [](const char* body, size_t len) {
+            MessageRoute route;
+            if (!scanMessageRoute(body, len, route)) {
+                route = parseMessageRoute(body, len);
+            }
+        });
+
+        std::cout << std::setw(10) << message.size() / 1024 << "KB"
+                  << std::setw(12) << std::fixed << std::setprecision(2) << full * 1e6 << "us"
+                  << std::setw(12) << scan * 1e6 << "us"
+                  << std::setw(9) << std::setprecision(1) << full / scan << "x" << std::endl;
+    }
+
+    std::cout << std::endl;
+    if (!identical) {
+        std::cout << "✗ Scanner and full parse disagree on the routing fields" << std::endl;
+        return 1;
+    }
+    std::cout << "✓ Scanner and full parse agree on the routing fields" << std::endl;
+
+    return 0;
+}
@@ -2,12 +2,14 @@
 # Build script for rvm-cpp
 
 echo "Installing dependencies (if needed)..."
-# You may need to run: sudo apt-get install libcurl4-openssl-dev libzip-dev nlohmann-json3-dev
+# You may need to run: sudo apt-get install libcurl4-openssl-dev libzip-dev zlib1g-dev libssl-dev nlohmann-json3-dev
 
 echo "Compiling rvm-cpp..."
 g++ -std=c++17 -o rvm-cpp main.cpp \
     -lcurl \
     -lzip \
+    -lz \
+    -lcrypto \
     -lpthread \
     -Wall \
     -O2
@@ -24,6 +26,6 @@ else
     echo "✗ Compilation failed"
     echo ""
     echo "Make sure you have the required dependencies installed:"
-    echo "  sudo apt-get install libcurl4-openssl-dev libzip-dev nlohmann-json3-dev build-essential"
+    echo "  sudo apt-get install libcurl4-openssl-dev libzip-dev zlib1g-dev libssl-dev nlohmann-json3-dev build-essential"
     exit 1
 fi
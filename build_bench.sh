@@ -0,0 +1,26 @@
+#!/bin/bash
+# Build script for the rvm-cpp benchmarks
+
+for bench in bench_extract bench_message bench_install; do
+    echo "Compiling $bench..."
+    g++ -std=c++17 -o $bench $bench.cpp \
+        -lcurl \
+        -lzip \
+        -lz \
+        -lcrypto \
+        -lpthread \
+        -Wall \
+        -O2
+
+    if [ $? -ne 0 ]; then
+        echo "✗ Compilation failed"
+        exit 1
+    fi
+done
+
+echo "✓ Compilation successful!"
+echo ""
+echo "Run with:"
+echo "./bench_extract <runtime.zip> [threads] [iterations]"
+echo "./bench_message [iterations]"
+echo "./bench_install [--files=3000] [--size-mb=150] [--iterations=3] [--output=<file>]"
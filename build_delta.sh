@@ -0,0 +1,22 @@
+#!/bin/bash
+# Build script for the runtime delta generator
+
+echo "Compiling make_delta..."
+g++ -std=c++17 -o make_delta make_delta.cpp \
+    -lcurl \
+    -lzip \
+    -lz \
+    -lcrypto \
+    -lpthread \
+    -Wall \
+    -O2
+
+if [ $? -eq 0 ]; then
+    echo "✓ Compilation successful!"
+    echo ""
+    echo "Run with:"
+    echo "./make_delta <base-dir> <target-dir> <output> [--from=<version>] [--to=<version>]"
+else
+    echo "✗ Compilation failed"
+    exit 1
+fi
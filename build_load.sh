@@ -0,0 +1,15 @@
+#!/bin/bash
+# Build script for the messaging socket load generator
+
+echo "Compiling load_socket..."
+g++ -std=c++17 -o load_socket load_socket.cpp -lpthread -Wall -O2
+
+if [ $? -eq 0 ]; then
+    echo "✓ Compilation successful!"
+    echo ""
+    echo "Run with (rvm-cpp must be running):"
+    echo "./load_socket --runtimes=8 --rate=1000 --duration=10 --dos-ratio=0.5"
+else
+    echo "✗ Compilation failed"
+    exit 1
+fi
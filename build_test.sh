@@ -3,6 +3,14 @@
 echo "Compiling test_socket..."
 g++ -o test_socket test_socket.cpp -std=c++17 -I/usr/include
 
+if [ $? -ne 0 ]; then
+    echo "✗ Compilation failed"
+    exit 1
+fi
+
+echo "Compiling http_standin..."
+g++ -o http_standin http_standin.cpp -std=c++17 -lpthread
+
 if [ $? -eq 0 ]; then
     echo "✓ Compilation successful!"
     echo ""
@@ -11,6 +19,10 @@ if [ $? -eq 0 ]; then
     echo ""
     echo "Note: Make sure rvm-cpp is running first, then send test data with:"
     echo "echo 'test' | nc -U /tmp/test_socket"
+    echo ""
+    echo "Serve runtimes and manifests locally with:"
+    echo "./http_standin --root=<dir> --port=8080"
+    echo "./rvm-cpp --config=http://127.0.0.1:8080/app.json --runtime-dir=<directory> --runtime-base-url=http://127.0.0.1:8080/runtime"
 else
     echo "✗ Compilation failed"
     exit 1
@@ -0,0 +1,331 @@
+// Local HTTP stand-in for the OpenFin CDN.
+// Serves files from a directory with HEAD, single byte-range GET, ETag/Last-Modified
+// and conditional requests, plus knobs to throttle or cut responses so ranged,
+// resumed and cached downloads can be exercised without the real CDN.
+//
+// Usage: ./http_standin --root=<dir> [--port=<n>] [--throttle=<bytes/sec>]
+//                       [--drop-after=<bytes>] [--drop-count=<n>] [--no-ranges] [--quiet]
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <cstring>
+#include <ctime>
+#include <cerrno>
+#include <cstdlib>
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <algorithm>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+
+struct StandinOptions {
+    std::string root = ".";
+    int port = 0;
+    // Bytes per second per response, 0 = unlimited
+    long throttle = 0;
+    // Close the connection after this many body bytes (-1 = never) ...
+    long dropAfter = -1;
+    // ... for the first dropCount responses only
+    int dropCount = 0;
+    bool ranges = true;
+    bool quiet = false;
+};
+
+// Counters so callers can check what was actually transferred
+struct StandinStats {
+    std::atomic<long> requests{0};
+    std::atomic<long> bytesSent{0};
+    std::atomic<long> notModified{0};
+    std::atomic<int> dropped{0};
+};
+
+static std::string httpDate(time_t t) {
+    char buf[64];
+    struct tm tm;
+    gmtime_r(&t, &tm);
+    strftime(buf, sizeof(buf), "%a, %d %b %Y %H:%M:%S GMT", &tm);
+    return buf;
+}
+
+static bool sendAll(int fd, const char* data, size_t len) {
+    while (len > 0) {
+        ssize_t n = send(fd, data, len, MSG_NOSIGNAL);
+        if (n <= 0) return false;
+        data += n;
+        len -= n;
+    }
+    return true;
+}
+
+// A byte position from a Range header: digits only, and no overflow
+static bool parseOffset(const std::string& text, off_t& value) {
+    if (text.empty() || text.find_first_not_of("0123456789") != std::string::npos) return false;
+    errno = 0;
+    long long parsed = strtoll(text.c_str(), nullptr, 10);
+    if (errno == ERANGE) return false;
+    value = (off_t)parsed;
+    return true;
+}
+
+static std::string contentType(const std::string& path) {
+    if (path.size() >= 5 && path.compare(path.size() - 5, 5, ".json") == 0) return "application/json";
+    return "application/octet-stream";
+}
+
+// Handle requests on one keep-alive connection
+static void serveConnection(int clientFd, StandinOptions opts, StandinStats* stats) {
+    std::string pending;
+    char buf[8192];
+
+    while (true) {
+        size_t headerEnd;
+        while ((headerEnd = pending.find("\r\n\r\n")) == std::string::npos) {
+            ssize_t n = recv(clientFd, buf, sizeof(buf), 0);
+            if (n <= 0) {
+                close(clientFd);
+                return;
+            }
+            pending.append(buf, n);
+        }
+
+        std::string head = pending.substr(0, headerEnd);
+        pending.erase(0, headerEnd + 4);
+        stats->requests++;
+
+        std::istringstream lines(head);
+        std::string method, target, version;
+        lines >> method >> target >> version;
+
+        std::string range, ifNoneMatch, ifModifiedSince, line;
+        std::getline(lines, line);
+        while (std::getline(lines, line)) {
+            if (!line.empty() && line.back() == '\r') line.pop_back();
+            size_t colon = line.find(':');
+            if (colon == std::string::npos) continue;
+            std::string name = line.substr(0, colon);
+            std::transform(name.begin(), name.end(), name.begin(), ::tolower);
+            std::string value = line.substr(colon + 1);
+            value.erase(0, value.find_first_not_of(' '));
+            if (name == "range") range = value;
+            else if (name == "if-none-match") ifNoneMatch = value;
+            else if (name == "if-modified-since") ifModifiedSince = value;
+        }
+
+        size_t query = target.find('?');
+        if (query != std::string::npos) target.erase(query);
+        std::string path = opts.root + target;
+
+        struct stat st;
+        bool found = target.find("..") == std::string::npos && stat(path.c_str(), &st) == 0 && S_ISREG(st.st_mode);
+        if (!found || (method != "GET" && method != "HEAD")) {
+            std::string body = found ? "Method not allowed\n" : "Not found\n";
+            std::string resp = std::string("HTTP/1.1 ") + (found ? "405 Method Not Allowed" : "404 Not Found") +
+                               "\r\nContent-Length: " + std::to_string(body.size()) + "\r\n\r\n" + body;
+            if (!opts.quiet) std::cout << method << " " << target << " -> " << (found ? 405 : 404) << std::endl;
+            if (!sendAll(clientFd, resp.data(), resp.size())) break;
+            continue;
+        }
+
+        std::string etag = "\"" + std::to_string(st.st_size) + "-" + std::to_string(st.st_mtime) + "\"";
+        std::string lastModified = httpDate(st.st_mtime);
+
+        if ((!ifNoneMatch.empty() && ifNoneMatch == etag) ||
+            (ifNoneMatch.empty() && !ifModifiedSince.empty() && ifModifiedSince == lastModified)) {
+            stats->notModified++;
+            std::string resp = "HTTP/1.1 304 Not Modified\r\nETag: " + etag + "\r\nLast-Modified: " + lastModified +
+                               "\r\nContent-Length: 0\r\n\r\n";
+            if (!opts.quiet) std::cout << method << " " << target << " -> 304" << std::endl;
+            if (!sendAll(clientFd, resp.data(), resp.size())) break;
+            continue;
+        }
+
+        off_t start = 0;
+        off_t end = st.st_size;   // exclusive
+        int status = 200;
+        if (opts.ranges && range.rfind("bytes=", 0) == 0) {
+            std::string spec = range.substr(6);
+            size_t dash = spec.find('-');
+            if (dash != std::string::npos && spec.find(',') == std::string::npos) {
+                std::string first = spec.substr(0, dash);
+                std::string last = spec.substr(dash + 1);
+                off_t from = 0, to = 0;
+                bool valid = first.empty() ? parseOffset(last, to)
+                                           : parseOffset(first, from) && (last.empty() || parseOffset(last, to));
+                if (!valid) {
+                    std::string resp = "HTTP/1.1 400 Bad Request\r\nContent-Length: 0\r\n\r\n";
+                    if (!opts.quiet) std::cout << method << " " << target << " -> 400 (Range: " << range << ")" << std::endl;
+                    if (!sendAll(clientFd, resp.data(), resp.size())) break;
+                    continue;
+                }
+                if (first.empty()) {
+                    start = std::max<off_t>(0, st.st_size - to);
+                } else {
+                    start = from;
+                    if (!last.empty()) end = std::min<off_t>(st.st_size, to + 1);
+                }
+                status = 206;
+            }
+            if (start >= end && st.st_size > 0) {
+                std::string resp = "HTTP/1.1 416 Range Not Satisfiable\r\nContent-Range: bytes */" +
+                                   std::to_string(st.st_size) + "\r\nContent-Length: 0\r\n\r\n";
+                if (!sendAll(clientFd, resp.data(), resp.size())) break;
+                continue;
+            }
+        }
+
+        std::string resp = std::string("HTTP/1.1 ") + (status == 206 ? "206 Partial Content" : "200 OK") + "\r\n";
+        resp += "Content-Type: " + contentType(path) + "\r\n";
+        resp += "Content-Length: " + std::to_string(end - start) + "\r\n";
+        if (opts.ranges) resp += "Accept-Ranges: bytes\r\n";
+        if (status == 206) {
+            resp += "Content-Range: bytes " + std::to_string(start) + "-" + std::to_string(end - 1) + "/" +
+                    std::to_string(st.st_size) + "\r\n";
+        }
+        resp += "ETag: " + etag + "\r\nLast-Modified: " + lastModified + "\r\n\r\n";
+
+        if (!opts.quiet) {
+            std::cout << method << " " << target << " -> " << status;
+            if (status == 206) std::cout << " [" << start << "-" << end - 1 << "]";
+            std::cout << std::endl;
+        }
+        if (!sendAll(clientFd, resp.data(), resp.size())) break;
+        if (method == "HEAD") continue;
+
+        // Decide whether this response gets cut short
+        long limit = -1;
+        if (opts.dropAfter >= 0 && stats->dropped.fetch_add(1) < opts.dropCount) {
+            limit = opts.dropAfter;
+        }
+
+        int fileFd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+        if (fileFd < 0) break;
+
+        off_t pos = start;
+        long sent = 0;
+        bool ok = true;
+        auto began = std::chrono::steady_clock::now();
+        char data[65536];
+        while (pos < end) {
+            size_t want = (size_t)std::min<off_t>(sizeof(data), end - pos);
+            if (limit >= 0) want = (size_t)std::min<long>(want, limit - sent);
+            if (want == 0) {
+                ok = false;
+                break;
+            }
+            ssize_t n = pread(fileFd, data, want, pos);
+            if (n <= 0 || !sendAll(clientFd, data, n)) {
+                ok = false;
+                break;
+            }
+            pos += n;
+            sent += n;
+            stats->bytesSent += n;
+
+            if (opts.throttle > 0) {
+                auto due = began + std::chrono::microseconds(sent * 1000000LL / opts.throttle);
+                std::this_thread::sleep_until(due);
+            }
+        }
+        close(fileFd);
+
+        if (!ok) {
+            if (!opts.quiet) std::cout << "  connection dropped after " << sent << " bytes" << std::endl;
+            break;
+        }
+    }
+
+    close(clientFd);
+}
+
+// Bind a listening socket on 127.0.0.1; port 0 picks a free port. Returns -1 on failure.
+int openStandinListener(int port, int* boundPort) {
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (fd < 0) return -1;
+
+    int one = 1;
+    setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    addr.sin_port = htons(port);
+
+    if (bind(fd, (struct sockaddr*)&addr, sizeof(addr)) < 0 || listen(fd, 128) < 0) {
+        close(fd);
+        return -1;
+    }
+
+    socklen_t len = sizeof(addr);
+    getsockname(fd, (struct sockaddr*)&addr, &len);
+    if (boundPort) *boundPort = ntohs(addr.sin_port);
+    return fd;
+}
+
+// Accept loop; every connection is served on its own thread
+void serveStandin(int listenFd, const StandinOptions& opts, StandinStats* stats) {
+    while (true) {
+        int clientFd = accept(listenFd, NULL, NULL);
+        if (clientFd < 0) {
+            if (errno == EINTR) continue;
+            break;
+        }
+        int one = 1;
+        setsockopt(clientFd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+        std::thread(serveConnection, clientFd, opts, stats).detach();
+    }
+}
+
+#ifndef HTTP_STANDIN_NO_MAIN
+int main(int argc, char* argv[]) {
+    StandinOptions opts;
+
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg.find("--root=") == 0) {
+            opts.root = arg.substr(7);
+        } else if (arg.find("--port=") == 0) {
+            opts.port = std::stoi(arg.substr(7));
+        } else if (arg.find("--throttle=") == 0) {
+            opts.throttle = std::stol(arg.substr(11));
+        } else if (arg.find("--drop-after=") == 0) {
+            opts.dropAfter = std::stol(arg.substr(13));
+        } else if (arg.find("--drop-count=") == 0) {
+            opts.dropCount = std::stoi(arg.substr(13));
+        } else if (arg == "--no-ranges") {
+            opts.ranges = false;
+        } else if (arg == "--quiet") {
+            opts.quiet = true;
+        } else {
+            std::cerr << "Usage: " << argv[0] << " --root=<dir> [--port=<n>] [--throttle=<bytes/sec>]"
+                      << " [--drop-after=<bytes>] [--drop-count=<n>] [--no-ranges] [--quiet]" << std::endl;
+            return 1;
+        }
+    }
+    if (opts.dropAfter >= 0 && opts.dropCount == 0) {
+        opts.dropCount = 1;
+    }
+
+    int port = 0;
+    int listenFd = openStandinListener(opts.port, &port);
+    if (listenFd < 0) {
+        std::cerr << "Failed to listen on port " << opts.port << std::endl;
+        return 1;
+    }
+
+    std::cout << "Serving " << opts.root << " on http://127.0.0.1:" << port << std::endl;
+
+    StandinStats stats;
+    serveStandin(listenFd, opts, &stats);
+
+    close(listenFd);
+    return 0;
+}
+#endif // HTTP_STANDIN_NO_MAIN
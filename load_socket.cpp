@@ -0,0 +1,412 @@
+// Load generator for the RVM messaging socket.
+// Simulates N runtimes, each listening on its own socket and sending a mix of
+// get-rvm-info and get-desktop-owner-settings requests at a fixed total rate. Latency
+// is measured from a request's scheduled send time to its reply arriving on the
+// runtime's socket, so a stalled server is not hidden by a stalled sender.
+//
+// Usage: ./load_socket [--runtimes=8] [--rate=1000] [--duration=10] [--dos-ratio=0.5]
+//                      [--rvm-socket=/tmp/OpenFinRVM_Messaging] [--json]
+#include <iostream>
+#include <iomanip>
+#include <cstring>
+#include <cerrno>
+#include <cmath>
+#include <string>
+#include <vector>
+#include <map>
+#include <memory>
+#include <atomic>
+#include <thread>
+#include <chrono>
+#include <algorithm>
+#include <unistd.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <nlohmann/json.hpp>
+
+using json = nlohmann::json;
+using Clock = std::chrono::steady_clock;
+
+static const char* ACTIONS[] = {"get-rvm-info", "get-desktop-owner-settings"};
+
+struct LoadOptions {
+    int runtimes = 8;
+    double rate = 1000;
+    double duration = 10;
+    double dosRatio = 0.5;
+    // How long to wait for outstanding replies after the last request
+    double grace = 2;
+    std::string rvmSocket = "/tmp/OpenFinRVM_Messaging";
+    bool json = false;
+};
+
+// One simulated runtime: its listening socket and the requests it has sent
+struct Runtime {
+    int index = 0;
+    std::string socketPath;
+    int listenFd = -1;
+    // Scheduled send time (ns since start) and action of each request, by sequence number
+    std::vector<std::atomic<int64_t>> sentAt;
+    std::vector<uint8_t> actions;
+    std::atomic<size_t> sent{0};
+    std::atomic<size_t> acked{0};
+    std::atomic<size_t> sendErrors{0};
+    // Round-trip latencies in ns, per action; written by the listener thread only
+    std::vector<int64_t> latencies[2];
+    // Counted by the listener thread while the main thread watches for the last replies
+    std::atomic<size_t> replies{0};
+    std::atomic<size_t> unexpected{0};
+
+    explicit Runtime(size_t capacity) : sentAt(capacity), actions(capacity) {
+        for (auto& t : sentAt) t.store(-1);
+    }
+};
+
+static int64_t nanosSince(Clock::time_point start) {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - start).count();
+}
+
+static int connectUnix(const std::string& path) {
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0) return -1;
+
+    struct sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strncpy(addr.sun_path, path.c_str(), sizeof(addr.sun_path) - 1);
+    if (connect(fd, (struct sockaddr*)&addr, sizeof(addr)) < 0) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+static int listenUnix(const std::string& path) {
+    unlink(path.c_str());
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0) return -1;
+
+    struct sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strncpy(addr.sun_path, path.c_str(), sizeof(addr.sun_path) - 1);
+    if (bind(fd, (struct sockaddr*)&addr, sizeof(addr)) < 0 || listen(fd, SOMAXCONN) < 0) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+// Length of the first complete "<socket>:S:{...}" message in buffer, or 0
+static size_t frameLength(const std::string& buffer) {
+    size_t start = buffer.find(":S:");
+    if (start == std::string::npos) return 0;
+
+    int depth = 0;
+    bool inString = false;
+    bool escaped = false;
+    for (size_t i = start + 3; i < buffer.size(); i++) {
+        char c = buffer[i];
+        if (inString) {
+            if (escaped) escaped = false;
+            else if (c == '\\') escaped = true;
+            else if (c == '"') inString = false;
+        } else if (c == '"') {
+            inString = true;
+        } else if (c == '{') {
+            depth++;
+        } else if (c == '}' && --depth == 0) {
+            return i + 1;
+        }
+    }
+    return 0;
+}
+
+// Record the latency of a reply to one of this runtime's requests
+static void recordReply(Runtime& runtime, const std::string& message, Clock::time_point start) {
+    int64_t now = nanosSince(start);
+    size_t pos = message.find(":S:");
+    try {
+        auto reply = json::parse(message.substr(pos + 3));
+        std::string messageId = reply.value("messageId", "");
+        size_t dash = messageId.rfind('-');
+        size_t seq = std::stoul(messageId.substr(dash + 1));
+        int64_t sentAt = seq < runtime.sentAt.size() ? runtime.sentAt[seq].load(std::memory_order_acquire) : -1;
+        if (sentAt < 0) {
+            runtime.unexpected++;
+            return;
+        }
+        runtime.latencies[runtime.actions[seq]].push_back(now - sentAt);
+        runtime.replies++;
+    } catch (const std::exception&) {
+        runtime.unexpected++;
+    }
+}
+
+// Accept the RVM's connections to this runtime, acknowledge every reply with RESP
+// and record its latency, until stopAt (ns since start)
+static void runListener(Runtime& runtime, Clock::time_point start, const std::atomic<int64_t>& stopAt) {
+    std::vector<int> clients;
+    std::map<int, std::string> buffers;
+    std::vector<char> scratch(65536);
+
+    while (nanosSince(start) < stopAt.load()) {
+        std::vector<struct pollfd> fds;
+        fds.push_back({runtime.listenFd, POLLIN, 0});
+        for (int fd : clients) fds.push_back({fd, POLLIN, 0});
+        if (poll(fds.data(), fds.size(), 50) <= 0) continue;
+
+        if (fds[0].revents & POLLIN) {
+            int fd = accept4(runtime.listenFd, NULL, NULL, SOCK_CLOEXEC);
+            if (fd >= 0) clients.push_back(fd);
+        }
+        for (size_t i = 1; i < fds.size(); i++) {
+            if (!fds[i].revents) continue;
+            int fd = fds[i].fd;
+            ssize_t n = recv(fd, scratch.data(), scratch.size(), 0);
+            if (n <= 0) {
+                close(fd);
+                buffers.erase(fd);
+                clients.erase(std::find(clients.begin(), clients.end(), fd));
+                continue;
+            }
+            std::string& buffer = buffers[fd];
+            buffer.append(scratch.data(), n);
+            size_t length;
+            while ((length = frameLength(buffer)) > 0) {
+                recordReply(runtime, buffer.substr(0, length), start);
+                buffer.erase(0, length);
+                send(fd, "RESP", 4, MSG_NOSIGNAL);
+            }
+        }
+    }
+    for (int fd : clients) close(fd);
+}
+
+// Send this runtime's share of the load over one messaging connection, then wait
+// for the server's RESP for each request
+static void runSender(Runtime& runtime, const LoadOptions& options, Clock::time_point start) {
+    int fd = connectUnix(options.rvmSocket);
+    if (fd < 0) {
+        runtime.sendErrors++;
+        return;
+    }
+
+    double interval = options.runtimes / options.rate;
+    size_t total = runtime.sentAt.size();
+    // Stagger runtimes so their requests do not all fire in the same instant
+    double offset = interval * runtime.index / options.runtimes;
+    uint32_t random = 2463534242u + runtime.index;
+    char acks[256];
+
+    for (size_t seq = 0; seq < total; seq++) {
+        int64_t due = (int64_t)((offset + seq * interval) * 1e9);
+        int64_t wait = due - nanosSince(start);
+        if (wait > 0) {
+            std::this_thread::sleep_for(std::chrono::nanoseconds(wait));
+        }
+
+        random ^= random << 13;
+        random ^= random >> 17;
+        random ^= random << 5;
+        uint8_t action = (random % 10000) < options.dosRatio * 10000 ? 1 : 0;
+        runtime.actions[seq] = action;
+
+        json payload = {
+            {"topic", action ? "application" : "system"},
+            {"messageId", "load-" + std::to_string(runtime.index) + "-" + std::to_string(seq)},
+            {"payload", {
+                {"action", ACTIONS[action]}
+            }}
+        };
+        std::string message = runtime.socketPath + ":S:" + payload.dump();
+
+        runtime.sentAt[seq].store(due, std::memory_order_release);
+        if (send(fd, message.data(), message.size(), MSG_NOSIGNAL) != (ssize_t)message.size()) {
+            runtime.sendErrors++;
+            break;
+        }
+        runtime.sent++;
+
+        ssize_t n;
+        while ((n = recv(fd, acks, sizeof(acks), MSG_DONTWAIT)) > 0) {
+            runtime.acked += n / 4;
+        }
+    }
+
+    // Collect the remaining acknowledgements
+    struct pollfd pfd = {fd, POLLIN, 0};
+    while (runtime.acked < runtime.sent && poll(&pfd, 1, (int)(options.grace * 1000)) > 0) {
+        ssize_t n = recv(fd, acks, sizeof(acks), 0);
+        if (n <= 0) break;
+        runtime.acked += n / 4;
+    }
+    close(fd);
+}
+
+static int64_t percentile(const std::vector<int64_t>& sorted, double fraction) {
+    if (sorted.empty()) return 0;
+    size_t rank = (size_t)std::ceil(fraction * sorted.size());
+    return sorted[std::min(sorted.size() - 1, rank > 0 ? rank - 1 : 0)];
+}
+
+static json latencySummary(std::vector<int64_t>& samples) {
+    std::sort(samples.begin(), samples.end());
+    double sum = 0;
+    for (int64_t s : samples) sum += s;
+    return {
+        {"count", samples.size()},
+        {"mean_us", samples.empty() ? 0 : sum / samples.size() / 1000},
+        {"p50_us", percentile(samples, 0.5) / 1000.0},
+        {"p90_us", percentile(samples, 0.9) / 1000.0},
+        {"p99_us", percentile(samples, 0.99) / 1000.0},
+        {"p999_us", percentile(samples, 0.999) / 1000.0},
+        {"max_us", samples.empty() ? 0 : samples.back() / 1000.0}
+    };
+}
+
+static void printLatency(const std::string& name, const json& summary) {
+    std::cout << std::left << std::setw(28) << name << std::right << std::fixed << std::setprecision(1)
+              << std::setw(9) << summary["count"].get<size_t>()
+              << std::setw(10) << summary["p50_us"].get<double>()
+              << std::setw(10) << summary["p90_us"].get<double>()
+              << std::setw(10) << summary["p99_us"].get<double>()
+              << std::setw(10) << summary["p999_us"].get<double>()
+              << std::setw(10) << summary["max_us"].get<double>() << std::endl;
+}
+
+int main(int argc, char* argv[]) {
+    LoadOptions options;
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg.find("--runtimes=") == 0) {
+            options.runtimes = std::max(1, std::stoi(arg.substr(11)));
+        } else if (arg.find("--rate=") == 0) {
+            options.rate = std::stod(arg.substr(7));
+        } else if (arg.find("--duration=") == 0) {
+            options.duration = std::stod(arg.substr(11));
+        } else if (arg.find("--dos-ratio=") == 0) {
+            options.dosRatio = std::stod(arg.substr(12));
+        } else if (arg.find("--rvm-socket=") == 0) {
+            options.rvmSocket = arg.substr(13);
+        } else if (arg == "--json") {
+            options.json = true;
+        } else {
+            std::cerr << "Usage: " << argv[0] << " [--runtimes=<n>] [--rate=<msgs/sec>] [--duration=<sec>]"
+                      << " [--dos-ratio=<0..1>] [--rvm-socket=<path>] [--json]" << std::endl;
+            return 1;
+        }
+    }
+    if (options.rate <= 0 || options.duration <= 0) {
+        std::cerr << "--rate and --duration must be positive" << std::endl;
+        return 1;
+    }
+
+    size_t perRuntime = std::max<size_t>(1, (size_t)(options.rate * options.duration / options.runtimes));
+    std::vector<std::unique_ptr<Runtime>> runtimes;
+    for (int i = 0; i < options.runtimes; i++) {
+        std::unique_ptr<Runtime> runtime(new Runtime(perRuntime));
+        runtime->index = i;
+        runtime->socketPath = "/tmp/rvm-load-" + std::to_string(getpid()) + "-" + std::to_string(i);
+        runtime->listenFd = listenUnix(runtime->socketPath);
+        if (runtime->listenFd < 0) {
+            std::cerr << "Failed to listen on " << runtime->socketPath << ": " << strerror(errno) << std::endl;
+            return 1;
+        }
+        runtimes.push_back(std::move(runtime));
+    }
+
+    int probe = connectUnix(options.rvmSocket);
+    if (probe < 0) {
+        std::cerr << "Failed to connect to " << options.rvmSocket << std::endl;
+        std::cerr << "Make sure rvm-cpp is running!" << std::endl;
+        return 1;
+    }
+    close(probe);
+
+    if (!options.json) {
+        std::cout << "Runtimes: " << options.runtimes << ", rate: " << options.rate << " msg/s, duration: "
+                  << options.duration << " s, desktop-owner-settings share: " << options.dosRatio << std::endl;
+    }
+
+    auto start = Clock::now();
+    std::atomic<int64_t> stopAt{INT64_MAX};
+    std::vector<std::thread> listeners;
+    std::vector<std::thread> senders;
+    for (auto& runtime : runtimes) {
+        listeners.emplace_back(runListener, std::ref(*runtime), start, std::cref(stopAt));
+    }
+    for (auto& runtime : runtimes) {
+        senders.emplace_back(runSender, std::ref(*runtime), std::cref(options), start);
+    }
+    for (auto& sender : senders) sender.join();
+    double sendSeconds = nanosSince(start) / 1e9;
+
+    // Give replies still in flight the grace period, but stop as soon as all are in
+    size_t sent = 0;
+    for (auto& runtime : runtimes) sent += runtime->sent;
+    int64_t deadline = nanosSince(start) + (int64_t)(options.grace * 1e9);
+    while (nanosSince(start) < deadline) {
+        size_t seen = 0;
+        for (auto& runtime : runtimes) seen += runtime->replies + runtime->unexpected;
+        if (seen >= sent) break;
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+    stopAt.store(nanosSince(start));
+    for (auto& listener : listeners) listener.join();
+    double totalSeconds = nanosSince(start) / 1e9;
+
+    size_t acked = 0, replies = 0, unexpected = 0, sendErrors = 0;
+    std::vector<int64_t> all, byAction[2];
+    for (auto& runtime : runtimes) {
+        acked += runtime->acked;
+        replies += runtime->replies;
+        unexpected += runtime->unexpected;
+        sendErrors += runtime->sendErrors;
+        for (int a = 0; a < 2; a++) {
+            byAction[a].insert(byAction[a].end(), runtime->latencies[a].begin(), runtime->latencies[a].end());
+            all.insert(all.end(), runtime->latencies[a].begin(), runtime->latencies[a].end());
+        }
+        close(runtime->listenFd);
+        unlink(runtime->socketPath.c_str());
+    }
+
+    json report = {
+        {"runtimes", options.runtimes},
+        {"target_rate", options.rate},
+        {"duration_seconds", sendSeconds},
+        {"sent", sent},
+        {"acked", acked},
+        {"replies", replies},
+        {"lost", sent > replies ? sent - replies : 0},
+        {"unexpected", unexpected},
+        {"send_errors", sendErrors},
+        {"throughput", replies / totalSeconds},
+        {"latency", latencySummary(all)},
+        {"latency_by_action", {
+            {ACTIONS[0], latencySummary(byAction[0])},
+            {ACTIONS[1], latencySummary(byAction[1])}
+        }}
+    };
+
+    if (options.json) {
+        std::cout << report.dump(2) << std::endl;
+    } else {
+        std::cout << std::endl;
+        std::cout << "Sent " << sent << " request(s) in " << std::fixed << std::setprecision(2) << sendSeconds
+                  << " s, " << acked << " RESP, " << replies << " reply(s), " << report["lost"].get<size_t>()
+                  << " lost, " << unexpected << " unexpected, " << sendErrors << " send error(s)" << std::endl;
+        std::cout << "Throughput: " << std::setprecision(1) << report["throughput"].get<double>() << " reply(s)/s"
+                  << std::endl;
+        std::cout << std::endl;
+        std::cout << std::left << std::setw(28) << "round trip (us)" << std::right << std::setw(9) << "count"
+                  << std::setw(10) << "p50" << std::setw(10) << "p90" << std::setw(10) << "p99"
+                  << std::setw(10) << "p999" << std::setw(10) << "max" << std::endl;
+        printLatency("all", report["latency"]);
+        printLatency(ACTIONS[0], report["latency_by_action"][ACTIONS[0]]);
+        printLatency(ACTIONS[1], report["latency_by_action"][ACTIONS[1]]);
+    }
+
+    return (sendErrors == 0 && replies == sent) ? 0 : 1;
+}
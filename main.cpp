@@ -5,16 +5,43 @@
 #include <vector>
 #include <cstring>
 #include <ctime>
+#include <cmath>
+#include <memory>
+#include <unordered_map>
+#include <map>
+#include <cerrno>
+#include <fcntl.h>
 #include <unistd.h>
 #include <sys/socket.h>
 #include <sys/un.h>
 #include <sys/stat.h>
 #include <sys/wait.h>
+#include <sys/file.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <sys/signalfd.h>
+#include <signal.h>
+#include <spawn.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <poll.h>
 #include <thread>
+#include <mutex>
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <future>
+#include <deque>
+#include <chrono>
 #include <algorithm>
 #include <iomanip>
+#include <sys/ioctl.h>
+#include <dirent.h>
+#include <linux/fs.h>
 #include <curl/curl.h>
 #include <zip.h>
+#include <zlib.h>
+#include <openssl/evp.h>
 #include <nlohmann/json.hpp>
 
 using json = nlohmann::json;
@@ -26,6 +53,327 @@ std::string startTime;
 struct Config {
     std::string version;
     std::string arguments;
+    // SHA-256 of the runtime archive (runtime.sha256), lower-case hex; empty if not published
+    std::string sha256;
+};
+
+// Result of a single manifest fetch performed by fetchConfigs()
+struct FetchResult {
+    std::string url;
+    bool ok = false;
+    Config config;
+    std::string error;
+    // Config came from the on-disk manifest cache rather than a fresh response
+    bool fromCache = false;
+};
+
+// Default per-request timeout for manifest fetches (milliseconds)
+const long DEFAULT_FETCH_TIMEOUT_MS = 30000;
+
+// How fetchConfigs() talks to the network and the manifest cache
+struct FetchOptions {
+    long timeoutMs = DEFAULT_FETCH_TIMEOUT_MS;
+    // Manifests are cached here (one <sha256(url)>.json per URL); empty disables caching
+    std::string cacheDir;
+    // Answer from the cache right away and revalidate in the background
+    bool staleWhileRevalidate = false;
+};
+
+// A manifest body as stored in the cache, with the validators it was served with
+struct CachedManifest {
+    bool valid = false;
+    std::string body;
+    std::string etag;
+    std::string lastModified;
+};
+
+// Raised when the server answers with a non-success HTTP status
+struct HttpError : std::runtime_error {
+    using std::runtime_error::runtime_error;
+};
+
+// Limits applied to a runtime download so it stays out of the way of running apps
+struct DownloadLimits {
+    // Receive rate for the whole download in bytes/sec, split across its connections; 0 is unlimited
+    curl_off_t maxBytesPerSec = 0;
+    // Stop (resumably) as soon as applications are being launched, by throwing DownloadYielded
+    bool yieldToLaunches = false;
+};
+
+// Raised when a download stopped to give way to application launches
+struct DownloadYielded : std::runtime_error {
+    using std::runtime_error::runtime_error;
+};
+
+// Raised when a downloaded archive does not have the expected SHA-256
+struct DigestMismatch : std::runtime_error {
+    using std::runtime_error::runtime_error;
+};
+
+// How installed runtimes are checked against their index before a launch
+enum VerifyMode {
+    VERIFY_OFF,
+    // Every indexed file exists with its recorded size
+    VERIFY_QUICK,
+    // Also recompute every file's CRC-32
+    VERIFY_FULL
+};
+
+// How runtime archives are installed
+struct InstallOptions {
+    // Extract while downloading instead of going through a temporary zip file
+    bool streaming = false;
+    // Worker threads for extractZip(); 0 uses every available core
+    int extractThreads = 0;
+    // Content-addressed object store shared by all versions; empty disables deduplication
+    std::string objectStoreDir;
+    // Parallel HTTP Range connections used for the archive download
+    int downloadConnections = 4;
+    // Where partial archives and their progress are kept between runs; empty uses /tmp
+    std::string downloadDir;
+    DownloadLimits limits;
+    // SHA-256 the archive must have (hex); empty skips the check unless a published one is fetched
+    std::string expectedSha256;
+    // Without expectedSha256, fetch <download URL>.sha256 and fail the install if there is none
+    bool publishedDigest = false;
+    // Build new versions from <download URL>.from-<installed version>.delta when one exists
+    bool deltaUpdates = false;
+    // Check applied to an installed version before it is reused or launched
+    VerifyMode verify = VERIFY_QUICK;
+};
+
+// Where runtime archives are downloaded from (<base>/<arch>/<version>)
+const std::string DEFAULT_RUNTIME_BASE_URL = "https://cdn.openfin.co/release/runtime/linux";
+
+// Ranged downloads are split into chunks of this size; progress is persisted per chunk
+const uint64_t DOWNLOAD_CHUNK_SIZE = 8 * 1024 * 1024;
+// Attempts per chunk before the download is abandoned (and left for a later resume)
+const int DOWNLOAD_CHUNK_ATTEMPTS = 3;
+
+// What a HEAD request tells us about a remote file
+struct RemoteFileInfo {
+    curl_off_t size = -1;
+    bool acceptsRanges = false;
+    // ETag, or Last-Modified when there is no ETag
+    std::string validator;
+};
+
+// Connection reuse seen by HttpClient so far
+struct HttpStats {
+    long requests = 0;
+    // Connections opened; the remaining requests reused (or multiplexed onto) an existing one
+    long connections = 0;
+};
+
+// Process-wide HTTP client shared by manifest fetches and runtime downloads: one curl
+// share handle caching DNS and TLS sessions, plus a pool of easy handles. Connections
+// are not shared, since libcurl does not support using one connection cache from
+// several threads; each pooled handle, and each multi handle, keeps its own.
+class HttpClient {
+public:
+    static HttpClient& instance();
+    
+    // Pooled easy handle with the shared caches and common options applied
+    CURL* acquire();
+    // Return a handle after its transfer; records whether it needed a new connection
+    void release(CURL* curl);
+    // Multi handle that multiplexes transfers over HTTP/2 where the server allows it
+    CURLM* createMulti();
+    HttpStats stats();
+    
+private:
+    HttpClient();
+    static void lockShare(CURL* curl, curl_lock_data data, curl_lock_access access, void* client);
+    static void unlockShare(CURL* curl, curl_lock_data data, void* client);
+    
+    CURLSH* share;
+    std::mutex shareLocks[CURL_LOCK_DATA_LAST];
+    std::mutex poolMutex;
+    std::vector<CURL*> idle;
+    std::atomic<long> requests{0};
+    std::atomic<long> connections{0};
+};
+
+// Idle easy handles kept by HttpClient
+const size_t HTTP_POOL_SIZE = 16;
+
+// Read buffer used by each extraction worker
+const size_t EXTRACT_BUFFER_SIZE = 256 * 1024;
+
+// Creates directories below an extraction root and caches their descriptors, so
+// extracted files are created with openat() relative to their parent directory
+class DirectoryCache {
+public:
+    explicit DirectoryCache(const std::string& root);
+    ~DirectoryCache();
+    DirectoryCache(const DirectoryCache&) = delete;
+    DirectoryCache& operator=(const DirectoryCache&) = delete;
+    
+    // Descriptor of root/relativeDir, creating missing components; -1 on failure
+    int get(const std::string& relativeDir);
+    
+private:
+    int getLocked(const std::string& relativeDir);
+    
+    int rootFd = -1;
+    std::unordered_map<std::string, int> fds;
+    std::mutex mutex;
+};
+
+// Incremental SHA-256 (OpenSSL EVP)
+class Sha256 {
+public:
+    Sha256();
+    ~Sha256();
+    Sha256(const Sha256&) = delete;
+    Sha256& operator=(const Sha256&) = delete;
+    
+    void update(const void* data, size_t len);
+    std::string hexDigest();
+    
+private:
+    EVP_MD_CTX* ctx;
+};
+
+// SHA-256 of a download, computed as its bytes are written. Bytes that land ahead of
+// the hashed prefix (parallel ranged chunks, resumed chunks) are remembered and read
+// back from the file once the prefix reaches them, while still in the page cache.
+class ArchiveDigest {
+public:
+    // data was written at offset of fd
+    void written(int fd, uint64_t offset, const void* data, size_t len);
+    // [offset, end) of fd is already on disk from an earlier run
+    void present(uint64_t offset, uint64_t end);
+    // Start over, e.g. when a ranged download falls back to a plain GET
+    void reset();
+    // Hash whatever of fd's first size bytes is still missing; returns the hex digest
+    std::string finish(int fd, uint64_t size);
+    
+private:
+    bool catchUp(int fd, uint64_t end);
+    
+    std::unique_ptr<Sha256> hash{new Sha256()};
+    uint64_t hashed = 0;
+    // Written ranges beyond the hashed prefix, start -> end
+    std::map<uint64_t, uint64_t> ahead;
+};
+
+// One file of an installed runtime version, as recorded in the store index
+struct StoredFile {
+    std::string path;
+    uint64_t size = 0;
+    uint32_t crc = 0;
+    mode_t mode = 0644;
+    std::string sha256;
+};
+
+// Content-addressed store of extracted files inside --runtime-dir.
+// Objects live at <root>/<first two hex digits>/<sha256> and version directories are
+// populated with reflinks (when the filesystem supports them) or hardlinks to them.
+// Executables are kept out of the store so a shared inode never changes mode.
+// <root>/index/<version>.json records every file of an installed version, which lets
+// later installs reuse unchanged files without writing them again.
+class ObjectStore {
+public:
+    explicit ObjectStore(const std::string& root);
+    
+    // Object an installed version recorded for a file with this path, size and CRC-32,
+    // or "". Only a candidate: the content has to be checked against it before linking.
+    std::string findKnown(const std::string& path, uint64_t size, uint32_t crc);
+    // Open the object for sha256 for reading; returns the descriptor or -1
+    int openObject(const std::string& sha256);
+    // Create a temporary file to extract into; returns the descriptor or -1
+    int createTemp(std::string& tmpName, uint64_t size);
+    void discardTemp(const std::string& tmpName);
+    // Move a finished temporary file into the store under its digest
+    bool commitTemp(const std::string& tmpName, const std::string& sha256);
+    // Place the object for sha256 at name inside a version directory
+    bool materialize(const std::string& sha256, DirectoryCache& target, const std::string& name);
+    // Replace a stored link at name with a private copy carrying mode
+    bool detach(DirectoryCache& target, const std::string& name, mode_t mode);
+    // Make the file already written at name the object for sha256, or link name to the
+    // existing object if there is one
+    bool adopt(DirectoryCache& target, const std::string& name, const std::string& sha256);
+    
+    void record(const StoredFile& file);
+    // Write the index of everything recorded so far for version
+    void writeIndex(const std::string& version);
+    
+private:
+    void loadIndexes();
+    static std::string knownKey(const std::string& path, uint64_t size, uint32_t crc);
+    
+    std::string root;
+    DirectoryCache dirs;
+    int tmpDirFd = -1;
+    std::atomic<bool> reflinks{true};
+    std::atomic<unsigned> tmpCounter{0};
+    std::unordered_map<std::string, std::string> known;
+    std::map<std::string, StoredFile> recorded;
+    std::mutex mutex;
+};
+
+// Per-file index written into every installed version directory
+const std::string INSTALL_INDEX_FILE = ".rvm-index.json";
+
+// Size and CRC-32 of every file extracted for one version, computed over the bytes
+// written (which must match the archive's). The index lets a later launch check the
+// install without the archive.
+class InstallIndex {
+public:
+    void record(const std::string& path, uint64_t size, uint32_t crc);
+    // Write the index into versionDir (before it is renamed into place)
+    void write(const std::string& versionDir);
+    
+private:
+    std::map<std::string, std::pair<uint64_t, uint32_t>> files;
+    std::mutex mutex;
+};
+
+// A runtime delta package is a gzip stream of DELTA_MAGIC, the u32 format version, a
+// u32 length and a JSON header listing every file of the new version as "base" (same
+// as in the base version), "data" or "patch". The contents of the "data" and "patch"
+// files follow in header order: raw bytes, or DeltaOp instructions against the file of
+// the same path in the base version. Integers are little-endian.
+const char DELTA_MAGIC[8] = {'R', 'V', 'M', 'D', 'E', 'L', 'T', 'A'};
+const uint32_t DELTA_FORMAT_VERSION = 1;
+// Largest JSON header a delta may declare; real ones list a few thousand files
+const uint32_t MAX_DELTA_HEADER_SIZE = 8 * 1024 * 1024;
+
+enum DeltaOp : uint8_t {
+    DELTA_END = 0,
+    // u64 offset, u32 length: bytes copied from the base file
+    DELTA_COPY = 1,
+    // u32 length, then that many literal bytes
+    DELTA_ADD = 2
+};
+
+// Size of the in-memory buffer between the downloader and the streaming extractor
+const size_t STREAM_BUFFER_SIZE = 16 * 1024 * 1024;
+
+// Bounded byte pipe between the download (producer) and extraction (consumer) threads
+class StreamBuffer {
+public:
+    explicit StreamBuffer(size_t capacity) : buffer(capacity) {}
+    
+    // Blocks while the buffer is full. Returns false once the consumer has aborted.
+    bool write(const char* data, size_t len);
+    // Blocks while the buffer is empty. Returns 0 at end of stream.
+    size_t read(char* data, size_t len);
+    // Producer: no more data will be written
+    void finish();
+    // Consumer: stop accepting data, unblocking the producer
+    void abort();
+    
+private:
+    std::vector<char> buffer;
+    size_t head = 0;
+    size_t used = 0;
+    bool finished = false;
+    bool aborted = false;
+    std::mutex mutex;
+    std::condition_variable notFull;
+    std::condition_variable notEmpty;
 };
 
 // Structure for launch queue
@@ -36,257 +384,4078 @@ struct LaunchInfo {
     std::string runtimeVersion;
 };
 
-// Forward declarations
-void logWithTimestamp(const std::string& message);
-std::string getCPUArch();
-Config fetchConfig(const std::string& url);
-void downloadAndExtractRuntime(const std::string& downloadURL, const std::string& targetDir);
-void launchApplication(const std::string& appPath, const std::string& manifestUrl, 
-                       const std::string& runtimeArgs, const std::string& runtimeVersion);
-void startSocketServer(const std::string& socketPath, const std::string& manifestUrl);
-void handleConnection(int clientFd, const std::string& socketPath, const std::string& manifestUrl);
-void processMessage(const std::string& message, const std::string& socketPath, const std::string& manifestUrl);
-void processDOS(const std::string& runtimeSocketName, const std::string& messageId, 
-                const std::string& socketPath, const std::string& manifestUrl);
-void processRVMInfo(const std::string& runtimeSocketName, const std::string& messageId,
-                    const std::string& socketPath, const std::string& manifestUrl);
-void sendToRuntime(const std::string& runtimeSocketName, const json& payload, const std::string& socketPath);
-std::vector<std::string> split(const std::string& str, char delimiter);
-std::string trim(const std::string& str);
-bool fileExists(const std::string& path);
-void createDirectory(const std::string& path);
+// A runtime process started by ProcessSupervisor
+struct ChildProcess {
+    pid_t pid = -1;
+    std::string manifestUrl;
+    std::string runtimeVersion;
+    // Time posix_spawn() took to get the runtime executing
+    uint64_t launchMicros = 0;
+    std::chrono::steady_clock::time_point started;
+    bool running = true;
+    // waitpid() status once the process has exited
+    int status = 0;
+};
+
+// Exited processes remembered for the metrics reply, oldest dropped first
+const size_t SUPERVISOR_EXITED_HISTORY = 64;
+
+// Launches runtimes with posix_spawn() (vfork semantics, so the parent's page tables
+// are never copied) and reaps them from a thread reading SIGCHLD through a signalfd.
+// start() must run before any other thread exists so SIGCHLD stays blocked everywhere.
+class ProcessSupervisor {
+public:
+    static ProcessSupervisor& instance();
+    
+    void start();
+    // Spawn path with args; returns the pid or -1
+    pid_t launch(const std::string& path, const std::vector<std::string>& args,
+                 const std::string& manifestUrl, const std::string& runtimeVersion);
+    // Running and recently exited processes
+    json snapshot();
+    // Manifest of the running application pid is, or was started by; empty if none
+    std::string manifestUrlOf(pid_t pid);
+    
+private:
+    ProcessSupervisor() = default;
+    void run();
+    void reap();
+    
+    std::once_flag started;
+    int signalFd = -1;
+    std::mutex mutex;
+    std::map<pid_t, ChildProcess> running;
+    std::deque<ChildProcess> exited;
+};
+
+// How LaunchPipeline takes manifests from fetch to launch
+struct PipelineOptions {
+    std::string runtimeDir;
+    std::string runtimeBaseURL = DEFAULT_RUNTIME_BASE_URL;
+    FetchOptions fetch;
+    InstallOptions install;
+    // Runtime installs running at once; further ones wait for a slot
+    int maxDownloads = 2;
+    // Start each application once its runtime is ready; off only installs
+    bool launch = true;
+};
+
+// Runtime downloads running in this process, whichever pipeline or prefetch started
+// them, so --max-downloads holds for all of them together
+class DownloadSlots {
+public:
+    static DownloadSlots& instance();
+    
+    // Block until fewer than limit downloads are running, then count this one
+    void acquire(int limit);
+    void release();
+    
+private:
+    DownloadSlots() = default;
+    
+    std::mutex mutex;
+    std::condition_variable freed;
+    int active = 0;
+};
+
+// Moves every manifest through fetch -> install -> launch on its own, so an application
+// starts as soon as its manifest is in and its runtime is installed, whatever the other
+// manifests are doing. Manifests that need the same runtime version share one install.
+// Background threads hold a reference, so a pipeline may be dropped once started.
+class LaunchPipeline : public std::enable_shared_from_this<LaunchPipeline> {
+public:
+    LaunchPipeline(const std::vector<std::string>& urls, const PipelineOptions& options);
+    
+    // Run in the background; returns immediately
+    void start();
+    // Block until every manifest has launched or failed
+    void wait();
+    
+    // Whether any pipeline is running, or launched an application within LAUNCH_QUIET_PERIOD_MS
+    static bool launching();
+    
+private:
+    void manifestReady(const FetchResult& fetched);
+    void install(const std::string& version, const std::string& sha256);
+    void launch(const LaunchInfo& info);
+    void finish(size_t manifests);
+    
+    std::vector<std::string> urls;
+    PipelineOptions options;
+    std::chrono::steady_clock::time_point started;
+    std::mutex mutex;
+    std::condition_variable changed;
+    // Runtime versions being installed, with the applications waiting for each
+    std::map<std::string, std::vector<LaunchInfo>> installing;
+    // Installed versions already checked by this pipeline
+    std::map<std::string, bool> verified;
+    size_t remaining = 0;
+    size_t launched = 0;
+    
+    static std::atomic<int> activePipelines;
+    static std::atomic<int64_t> lastLaunch;
+};
+
+// Background work keeps off the machine for this long after an application launch
+const int LAUNCH_QUIET_PERIOD_MS = 10000;
+
+// Default receive rate of prefetch downloads (bytes/sec)
+const curl_off_t DEFAULT_PREFETCH_RATE = 2 * 1024 * 1024;
+
+// What RuntimePrefetcher watches and how hard it may use the machine
+struct PrefetchOptions {
+    std::vector<std::string> urls;
+    // Seconds between checks of the manifests; 0 disables prefetching
+    int intervalSeconds = 0;
+    // Download rate in bytes/sec; 0 is unlimited
+    curl_off_t maxBytesPerSec = DEFAULT_PREFETCH_RATE;
+};
+
+// Re-fetches a list of manifests every interval and installs the runtime versions they
+// name that are not installed yet, so a version bump does not cost the next launch a
+// full download. Runs at idle I/O priority with a capped download rate and stops
+// downloading while applications are being launched.
+class RuntimePrefetcher {
+public:
+    static RuntimePrefetcher& instance();
+    
+    // Start the prefetch thread; the first call's options win
+    void start(const PrefetchOptions& options, const PipelineOptions& pipeline);
+    
+private:
+    RuntimePrefetcher() = default;
+    void run();
+    void checkOnce();
+    void install(const std::string& version, const std::string& sha256);
+    
+    std::once_flag started;
+    PrefetchOptions options;
+    PipelineOptions pipeline;
+};
+
+// How manifests forwarded by later rvm-cpp invocations are installed and launched
+PipelineOptions launchRequestOptions;
+
+// Limits of the RVM messaging socket server
+struct SocketServerOptions {
+    // Open client connections; further clients wait in the listen backlog
+    int maxConnections = 256;
+    // Received messages waiting for a worker; clients are not read while this is full
+    int maxQueuedMessages = 1024;
+    // Threads handling messages (each reply blocks on the runtime's socket)
+    int workerThreads = 4;
+    // Clients that send nothing for this long are disconnected
+    int idleTimeoutMs = 60000;
+};
+
+// Why startSocketServer returned
+enum SocketServerResult {
+    // It listened until its event loop ended
+    SOCKET_SERVER_STOPPED,
+    // Another rvm-cpp is listening on the socket
+    SOCKET_SERVER_IN_USE,
+    // The socket could not be set up
+    SOCKET_SERVER_FAILED
+};
+
+// Delivery of replies to runtime sockets
+struct ReplyOptions {
+    // How long a runtime has to acknowledge a reply with RESP
+    int timeoutMs = 5000;
+    // Further attempts after a failed delivery before the reply is dropped
+    int retries = 3;
+    // Delay before the first retry, doubled for each further one
+    int backoffMs = 100;
+};
+
+// Replies waiting for one runtime beyond this are dropped, oldest first
+const size_t MAX_QUEUED_REPLIES_PER_RUNTIME = 256;
+
+// Largest message accepted on the messaging socket
+const size_t MAX_SOCKET_MESSAGE_SIZE = 16 * 1024 * 1024;
+
+// Recycles receive buffers in power-of-two size classes so connections only hold
+// memory while a message is being assembled. Not thread-safe (event loop only).
+class BufferPool {
+public:
+    // Empty string with at least minCapacity reserved
+    std::string acquire(size_t minCapacity);
+    void release(std::string&& buffer);
+    
+private:
+    static const size_t MIN_CLASS = 4096;
+    static const size_t MAX_POOLED = 1024 * 1024;
+    static const size_t PER_CLASS = 32;
+    
+    std::map<size_t, std::vector<std::string>> freeLists;
+};
+
+// Splits a messaging connection's byte stream into "<socket>:S:<json object>" messages.
+// Message ends are found by matching braces outside JSON strings, so messages can be
+// split across reads and several can arrive in one read. Anything else (no ":S:" before
+// a newline, or a body that is not an object) runs to the end of its line, or of what
+// has been received, and is passed on to be rejected and acknowledged like before.
+class MessageFramer {
+public:
+    // INVALID: more than MAX_SOCKET_MESSAGE_SIZE bytes without a message end
+    enum Status { NEED_MORE, MESSAGE, INVALID };
+    
+    explicit MessageFramer(BufferPool& pool);
+    ~MessageFramer();
+    MessageFramer(const MessageFramer&) = delete;
+    MessageFramer& operator=(const MessageFramer&) = delete;
+    
+    void append(const char* data, size_t len);
+    // Extract the next complete message into message
+    Status next(std::string& message);
+    // Buffered bytes that are not a complete message yet
+    size_t pending() const { return buffer.size(); }
+    // Whatever is buffered, for a peer that closed mid-message
+    std::string takeRemainder();
+    
+private:
+    void consume(size_t len);
+    // Take buffer up to end (or all of it) as a message, dropping the newline at end
+    Status takeLine(size_t end, std::string& message);
+    
+    BufferPool& pool;
+    std::string buffer;
+    size_t scanned = 0;
+    size_t bodyStart = std::string::npos;
+    int depth = 0;
+    bool inString = false;
+    bool escaped = false;
+};
+
+// Fixed set of threads draining a bounded task queue
+class WorkerPool {
+public:
+    // notifyFd (an eventfd, or -1) is signalled when a full queue gets a free slot
+    WorkerPool(int threads, size_t maxQueued, int notifyFd);
+    ~WorkerPool();
+    WorkerPool(const WorkerPool&) = delete;
+    WorkerPool& operator=(const WorkerPool&) = delete;
+    
+    // Queue a task; false if the queue is full
+    bool tryPost(std::function<void()> task);
+    
+private:
+    void run();
+    
+    std::vector<std::thread> workers;
+    std::deque<std::function<void()>> tasks;
+    size_t maxQueued;
+    int notifyFd;
+    bool stopping = false;
+    std::mutex mutex;
+    std::condition_variable ready;
+};
+
+// Idle connections kept per runtime socket, and how long they may stay unused
+const size_t RUNTIME_IDLE_CONNECTIONS = 4;
+const int RUNTIME_CONNECTION_IDLE_MS = 5 * 60 * 1000;
+
+// A connection to a runtime socket handed out by RuntimeConnectionPool
+struct RuntimeConnection {
+    int fd = -1;
+    // Inode of the socket file when connected; a new inode means the runtime restarted
+    ino_t inode = 0;
+    bool reused = false;
+};
+
+// Long-lived connections to runtime sockets, keyed by socket name and reused across replies
+class RuntimeConnectionPool {
+public:
+    static RuntimeConnectionPool& instance();
+    
+    // Healthy idle connection to runtimeSocketName, or a new one; fd is -1 on failure
+    RuntimeConnection acquire(const std::string& runtimeSocketName);
+    // Hand a connection back after an exchange; unhealthy ones are closed
+    void release(const std::string& runtimeSocketName, const RuntimeConnection& connection, bool healthy);
+    
+private:
+    struct IdleConnection {
+        RuntimeConnection connection;
+        std::chrono::steady_clock::time_point since;
+    };
+    
+    RuntimeConnectionPool() = default;
+    // Close idle connections of vanished sockets and ones unused for too long
+    void evictLocked(std::chrono::steady_clock::time_point now);
+    
+    std::mutex mutex;
+    std::unordered_map<std::string, std::vector<IdleConnection>> idle;
+    std::chrono::steady_clock::time_point lastEviction;
+};
+
+// The request a reply answers, for the per-action latency metrics
+struct ReplyOrigin {
+    // Empty for replies that are not tracked
+    std::string action;
+    std::chrono::steady_clock::time_point received;
+};
+
+// A reply waiting to be delivered to a runtime
+struct OutboundReply {
+    std::string message;
+    int attempts = 0;
+    ReplyOrigin origin;
+};
+
+// Delivers replies to runtime sockets from one I/O thread, so message handlers never
+// block on a runtime. Replies to the same runtime are sent in order, one at a time.
+class ReplyDispatcher {
+public:
+    static ReplyDispatcher& instance();
+    
+    // Start the I/O thread; the first call's options win
+    void start(const ReplyOptions& options);
+    // Queue a framed message ("<socket>:S:<json>") for runtimeSocketName
+    void enqueue(const std::string& runtimeSocketName, std::string message,
+                 const ReplyOrigin& origin = ReplyOrigin());
+    
+private:
+    // Delivery state of one runtime socket, owned by the I/O thread
+    struct Channel {
+        std::deque<OutboundReply> queue;
+        RuntimeConnection connection;
+        size_t sent = 0;
+        std::string ack;
+        bool inFlight = false;
+        std::chrono::steady_clock::time_point deadline;
+        std::chrono::steady_clock::time_point retryAt;
+    };
+    
+    ReplyDispatcher() = default;
+    void run();
+    void startNext(const std::string& name, Channel& channel);
+    void writeReply(const std::string& name, Channel& channel);
+    void readAck(const std::string& name, Channel& channel);
+    void finishReply(const std::string& name, Channel& channel);
+    void failReply(const std::string& name, Channel& channel, const std::string& reason, bool unreachable);
+    
+    ReplyOptions options;
+    std::once_flag started;
+    int epollFd = -1;
+    int wakeFd = -1;
+    std::mutex mutex;
+    std::vector<std::pair<std::string, OutboundReply>> incoming;
+    std::unordered_map<std::string, Channel> channels;
+    std::unordered_map<int, std::string> fdChannels;
+};
+
+// A serialized reply ("<socket>:S:<json>") split around its messageId value
+struct ResponseTemplate {
+    std::string prefix;
+    std::string suffix;
+    
+    // The reply for messageId, JSON-escaped into the gap
+    std::string render(const std::string& messageId) const;
+};
+
+// Replies whose only per-request field is messageId, serialized once per socket
+// path (and manifest URL for desktop owner settings)
+class ResponseTemplates {
+public:
+    static ResponseTemplates& instance();
+    
+    const ResponseTemplate& desktopOwnerSettings(const std::string& socketPath, const std::string& manifestUrl);
+    const ResponseTemplate& rvmInfo(const std::string& socketPath);
+    
+private:
+    ResponseTemplates() = default;
+    
+    std::mutex mutex;
+    std::unordered_map<std::string, ResponseTemplate> dos;
+    std::unordered_map<std::string, ResponseTemplate> rvm;
+};
+
+// The fields of a runtime message that processMessage() routes on
+struct MessageRoute {
+    std::string topic;
+    std::string messageId;
+    std::string action;
+};
+
+// Distribution of a latency (microseconds) or size in power-of-two buckets:
+// bucket 0 counts zeros and bucket i values in [2^(i-1), 2^i). Recording is lock-free.
+class Histogram {
+public:
+    void record(uint64_t value);
+    // count, sum, max, estimated percentiles and the non-empty buckets by upper bound
+    json toJson() const;
+    
+private:
+    static const int BUCKETS = 64;
+    
+    std::atomic<uint64_t> buckets[BUCKETS] = {};
+    std::atomic<uint64_t> count{0};
+    std::atomic<uint64_t> sum{0};
+    std::atomic<uint64_t> max{0};
+};
+
+// Process-wide counters and histograms, created on first use and never removed.
+// Returned references stay valid for the life of the process.
+class Metrics {
+public:
+    static Metrics& instance();
+    
+    std::atomic<uint64_t>& counter(const std::string& name);
+    Histogram& histogram(const std::string& name);
+    // Everything recorded so far, as {"uptime_seconds", "counters", "histograms"}
+    json snapshot();
+    
+private:
+    Metrics() : started(std::chrono::steady_clock::now()) {}
+    
+    std::chrono::steady_clock::time_point started;
+    std::mutex mutex;
+    std::map<std::string, std::unique_ptr<std::atomic<uint64_t>>> counters;
+    std::map<std::string, std::unique_ptr<Histogram>> histograms;
+};
+
+// Severity of a log line; lines below the configured level are discarded
+enum LogLevel { LOG_DEBUG, LOG_INFO, LOG_WARN, LOG_ERROR };
+
+// Where and how much logWithTimestamp() writes
+struct LogOptions {
+    LogLevel level = LOG_INFO;
+    // Log file; empty writes to stderr
+    std::string file;
+    // The file is rotated to <file>.1 .. <file>.<maxFiles> once it grows past this
+    uint64_t maxFileSize = 10 * 1024 * 1024;
+    int maxFiles = 5;
+};
+
+// Bytes of log records each thread can have waiting for the writer
+const size_t LOG_RING_SIZE = 256 * 1024;
+// Longer messages are truncated so a record always fits in a ring
+const size_t LOG_MAX_MESSAGE = 64 * 1024;
+
+// Asynchronous logger. Each logging thread appends records to its own single-producer
+// ring without taking locks; a background thread drains all rings in sequence order,
+// formats timestamps (once per second) and writes each batch with one write().
+class Logger {
+public:
+    static Logger& instance();
+    
+    // Takes effect for lines logged afterwards; a file that cannot be opened keeps stderr
+    void configure(const LogOptions& options);
+    bool enabled(LogLevel level) const { return level >= minLevel.load(std::memory_order_relaxed); }
+    void log(LogLevel level, const std::string& message);
+    // Block until everything logged so far has been written
+    void flush();
+    
+private:
+    struct Ring;
+    struct Record {
+        uint64_t seq;
+        time_t time;
+        LogLevel level;
+        std::string message;
+    };
+    
+    Logger();
+    Ring& threadRing();
+    void run();
+    // Move every committed record out of the rings; returns false if there were none
+    bool drain(const std::vector<std::shared_ptr<Ring>>& snapshot, std::vector<Record>& records);
+    void writeBatch(std::vector<Record>& records);
+    void openFile();
+    void rotate();
+    
+    std::atomic<int> minLevel{LOG_INFO};
+    std::atomic<uint64_t> nextSeq{0};
+    std::atomic<bool> wakeRequested{false};
+    // Rings of all threads that have logged; only touched when a thread logs first
+    std::mutex ringsMutex;
+    std::vector<std::shared_ptr<Ring>> rings;
+    // Writer state
+    std::mutex mutex;
+    std::condition_variable wake;
+    std::condition_variable flushed;
+    LogOptions options;
+    bool reopen = false;
+    int fd = STDERR_FILENO;
+    uint64_t fileSize = 0;
+    time_t cachedSecond = -1;
+    char cachedStamp[32];
+    std::string output;
+};
+
+// Forward declarations
+void logWithTimestamp(const std::string& message);
+void logWithTimestamp(LogLevel level, const std::string& message);
+bool logEnabled(LogLevel level);
+std::string getCPUArch();
+Config fetchConfig(const std::string& url);
+bool isValidRuntimeVersion(const std::string& version);
+Config parseConfig(const std::string& body);
+std::vector<FetchResult> fetchConfigs(const std::vector<std::string>& urls, const FetchOptions& options,
+                                      const std::function<void(const FetchResult&)>& onResult = nullptr);
+void extractZip(const std::string& zipPath, const std::string& destDir, int threads,
+                ObjectStore* store = nullptr, InstallIndex* index = nullptr);
+void extractZipStream(StreamBuffer& input, const std::string& destDir, ObjectStore* store = nullptr,
+                      InstallIndex* index = nullptr);
+bool verifyInstalledRuntime(const std::string& versionDir, bool full, std::string& problem);
+void applyRuntimeDelta(const std::string& deltaPath, const std::string& baseDir, const std::string& from,
+                       const std::string& stagingDir, const std::string& to, InstallIndex& index,
+                       ObjectStore* store = nullptr);
+void downloadArchive(const std::string& url, const std::string& path, int connections,
+                     const DownloadLimits& limits = DownloadLimits(), ArchiveDigest* digest = nullptr);
+void downloadAndExtractRuntime(const std::string& downloadURL, const std::string& targetDir,
+                               const InstallOptions& options);
+void launchApplication(const std::string& appPath, const std::string& manifestUrl, 
+                       const std::string& runtimeArgs, const std::string& runtimeVersion);
+SocketServerResult startSocketServer(const std::string& socketPath, const std::string& manifestUrl,
+                                     const SocketServerOptions& options,
+                                     const std::function<void()>& onListening = nullptr);
+void processMessage(const std::string& message, const std::string& socketPath, const std::string& manifestUrl,
+                    std::chrono::steady_clock::time_point received);
+bool scanMessageRoute(const char* body, size_t len, MessageRoute& route);
+MessageRoute parseMessageRoute(const char* body, size_t len);
+void processDOS(const std::string& runtimeSocketName, const std::string& messageId, 
+                const std::string& socketPath, const std::string& manifestUrl, const ReplyOrigin& origin);
+void processRVMInfo(const std::string& runtimeSocketName, const std::string& messageId,
+                    const std::string& socketPath, const std::string& manifestUrl, const ReplyOrigin& origin);
+void processMetrics(const std::string& runtimeSocketName, const std::string& messageId,
+                    const std::string& socketPath, const ReplyOrigin& origin);
+void processLaunchRequest(const char* body, size_t len);
+bool forwardLaunchRequest(const std::string& socketPath, const std::vector<std::string>& urls);
+void sendToRuntime(const std::string& runtimeSocketName, const json& payload, const std::string& socketPath,
+                   const ReplyOrigin& origin = ReplyOrigin());
+void countMetric(const std::string& name, uint64_t amount = 1);
+void recordMetric(const std::string& name, uint64_t value);
+uint64_t elapsedMicros(std::chrono::steady_clock::time_point since);
+std::vector<std::string> split(const std::string& str, char delimiter);
+std::string trim(const std::string& str);
+bool fileExists(const std::string& path);
+void createDirectory(const std::string& path);
+void removeDirectory(const std::string& path);
+
+// Logger
+// One thread's records: [header][message] entries in a byte ring, written by that
+// thread only and consumed by the writer
+struct Logger::Ring {
+    struct Header {
+        uint64_t seq;
+        time_t time;
+        uint32_t length;
+        uint32_t level;
+    };
+    
+    std::vector<char> data = std::vector<char>(LOG_RING_SIZE);
+    std::atomic<uint64_t> head{0};
+    std::atomic<uint64_t> tail{0};
+    // Records before this offset have been written out
+    std::atomic<uint64_t> written{0};
+    
+    void copyIn(uint64_t pos, const void* src, size_t len) {
+        size_t offset = pos % data.size();
+        size_t first = std::min(len, data.size() - offset);
+        memcpy(data.data() + offset, src, first);
+        memcpy(data.data(), (const char*)src + first, len - first);
+    }
+    
+    void copyOut(uint64_t pos, void* dst, size_t len) const {
+        size_t offset = pos % data.size();
+        size_t first = std::min(len, data.size() - offset);
+        memcpy(dst, data.data() + offset, first);
+        memcpy((char*)dst + first, data.data(), len - first);
+    }
+};
+
+Logger& Logger::instance() {
+    // Never destroyed: threads may log during exit
+    static Logger* logger = new Logger();
+    return *logger;
+}
+
+Logger::Logger() {
+    std::thread(&Logger::run, this).detach();
+    std::atexit([]() { Logger::instance().flush(); });
+}
+
+void Logger::configure(const LogOptions& logOptions) {
+    minLevel.store(logOptions.level, std::memory_order_relaxed);
+    std::lock_guard<std::mutex> lock(mutex);
+    options = logOptions;
+    reopen = true;
+}
+
+Logger::Ring& Logger::threadRing() {
+    // Shared with the writer, which drains it even after the thread has exited
+    thread_local std::shared_ptr<Ring> ring;
+    if (!ring) {
+        ring = std::make_shared<Ring>();
+        std::lock_guard<std::mutex> lock(ringsMutex);
+        rings.push_back(ring);
+    }
+    return *ring;
+}
+
+void Logger::log(LogLevel level, const std::string& message) {
+    if (!enabled(level)) return;
+    
+    Ring& ring = threadRing();
+    Ring::Header header;
+    header.time = std::time(nullptr);
+    header.length = (uint32_t)std::min(message.size(), LOG_MAX_MESSAGE);
+    header.level = level;
+    size_t needed = sizeof(header) + header.length;
+    
+    uint64_t head = ring.head.load(std::memory_order_relaxed);
+    while (ring.data.size() - (head - ring.tail.load(std::memory_order_acquire)) < needed) {
+        // Full: let the writer catch up
+        wakeRequested.store(true, std::memory_order_relaxed);
+        wake.notify_one();
+        std::this_thread::yield();
+    }
+    
+    header.seq = nextSeq.fetch_add(1, std::memory_order_relaxed);
+    ring.copyIn(head, &header, sizeof(header));
+    ring.copyIn(head + sizeof(header), message.data(), header.length);
+    ring.head.store(head + needed, std::memory_order_release);
+    
+    if (level >= LOG_ERROR) {
+        wakeRequested.store(true, std::memory_order_relaxed);
+        wake.notify_one();
+    }
+}
+
+void Logger::flush() {
+    std::vector<std::pair<std::shared_ptr<Ring>, uint64_t>> pending;
+    {
+        std::lock_guard<std::mutex> lock(ringsMutex);
+        for (auto& ring : rings) {
+            pending.emplace_back(ring, ring->head.load(std::memory_order_acquire));
+        }
+    }
+    
+    std::unique_lock<std::mutex> lock(mutex);
+    wakeRequested.store(true);
+    wake.notify_one();
+    // Bounded, in case the writer is gone (e.g. in a forked child)
+    flushed.wait_for(lock, std::chrono::seconds(2), [&]() {
+        for (auto& entry : pending) {
+            if (entry.first->written.load(std::memory_order_acquire) < entry.second) return false;
+        }
+        return true;
+    });
+}
+
+bool Logger::drain(const std::vector<std::shared_ptr<Ring>>& snapshot, std::vector<Record>& records) {
+    size_t before = records.size();
+    for (auto& ring : snapshot) {
+        uint64_t tail = ring->tail.load(std::memory_order_relaxed);
+        uint64_t head = ring->head.load(std::memory_order_acquire);
+        while (tail < head) {
+            Ring::Header header;
+            ring->copyOut(tail, &header, sizeof(header));
+            Record record{header.seq, header.time, (LogLevel)header.level, std::string(header.length, '\0')};
+            ring->copyOut(tail + sizeof(header), &record.message[0], header.length);
+            records.push_back(std::move(record));
+            tail += sizeof(header) + header.length;
+        }
+        ring->tail.store(tail, std::memory_order_release);
+    }
+    return records.size() > before;
+}
+
+void Logger::openFile() {
+    if (fd != STDERR_FILENO) {
+        close(fd);
+        fd = STDERR_FILENO;
+    }
+    fileSize = 0;
+    if (options.file.empty()) return;
+    
+    int fileFd = open(options.file.c_str(), O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+    if (fileFd < 0) {
+        std::string error = "Failed to open log file " + options.file + ": " + strerror(errno) + "\n";
+        ssize_t ignored = write(STDERR_FILENO, error.data(), error.size());
+        (void)ignored;
+        return;
+    }
+    struct stat st;
+    if (fstat(fileFd, &st) == 0) {
+        fileSize = st.st_size;
+    }
+    fd = fileFd;
+}
+
+void Logger::rotate() {
+    for (int i = options.maxFiles - 1; i >= 1; i--) {
+        rename((options.file + "." + std::to_string(i)).c_str(),
+               (options.file + "." + std::to_string(i + 1)).c_str());
+    }
+    if (options.maxFiles > 0) {
+        rename(options.file.c_str(), (options.file + ".1").c_str());
+    } else {
+        unlink(options.file.c_str());
+    }
+    openFile();
+}
+
+void Logger::writeBatch(std::vector<Record>& records) {
+    // Records of different threads interleave in the order they were logged
+    std::sort(records.begin(), records.end(), [](const Record& a, const Record& b) {
+        return a.seq < b.seq;
+    });
+    
+    output.clear();
+    for (const Record& record : records) {
+        if (record.time != cachedSecond) {
+            struct tm tm;
+            localtime_r(&record.time, &tm);
+            strftime(cachedStamp, sizeof(cachedStamp), "[%Y-%m-%d %H:%M:%S] ", &tm);
+            cachedSecond = record.time;
+        }
+        output += cachedStamp;
+        output += record.message;
+        if (record.message.size() == LOG_MAX_MESSAGE) {
+            output += "... (truncated)";
+        }
+        output += '\n';
+    }
+    
+    size_t written = 0;
+    while (written < output.size()) {
+        ssize_t n = write(fd, output.data() + written, output.size() - written);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            break;
+        }
+        written += n;
+    }
+    fileSize += written;
+    
+    if (fd != STDERR_FILENO && fileSize >= options.maxFileSize) {
+        rotate();
+    }
+}
+
+void Logger::run() {
+    std::vector<Record> records;
+    while (true) {
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            if (!wakeRequested.exchange(false)) {
+                wake.wait_for(lock, std::chrono::milliseconds(20));
+                wakeRequested.store(false);
+            }
+            if (reopen) {
+                reopen = false;
+                openFile();
+            }
+        }
+        
+        std::vector<std::shared_ptr<Ring>> snapshot;
+        {
+            std::lock_guard<std::mutex> lock(ringsMutex);
+            snapshot = rings;
+        }
+        
+        records.clear();
+        if (drain(snapshot, records)) {
+            writeBatch(records);
+        }
+        for (auto& ring : snapshot) {
+            ring->written.store(ring->tail.load(std::memory_order_relaxed), std::memory_order_release);
+        }
+        snapshot.clear();
+        
+        {
+            // Forget rings of exited threads once they are empty
+            std::lock_guard<std::mutex> lock(ringsMutex);
+            rings.erase(std::remove_if(rings.begin(), rings.end(), [](const std::shared_ptr<Ring>& ring) {
+                return ring.use_count() == 1 && ring->head.load() == ring->tail.load();
+            }), rings.end());
+        }
+        
+        std::lock_guard<std::mutex> lock(mutex);
+        flushed.notify_all();
+    }
+}
+
+// Log with timestamp
+void logWithTimestamp(const std::string& message) {
+    Logger::instance().log(LOG_INFO, message);
+}
+
+void logWithTimestamp(LogLevel level, const std::string& message) {
+    Logger::instance().log(level, message);
+}
+
+bool logEnabled(LogLevel level) {
+    return Logger::instance().enabled(level);
+}
+
+// Histogram
+void Histogram::record(uint64_t value) {
+    int bucket = value == 0 ? 0 : std::min(BUCKETS - 1, 64 - __builtin_clzll(value));
+    buckets[bucket].fetch_add(1, std::memory_order_relaxed);
+    count.fetch_add(1, std::memory_order_relaxed);
+    sum.fetch_add(value, std::memory_order_relaxed);
+    uint64_t seen = max.load(std::memory_order_relaxed);
+    while (value > seen && !max.compare_exchange_weak(seen, value, std::memory_order_relaxed)) {
+    }
+}
+
+json Histogram::toJson() const {
+    uint64_t counts[BUCKETS];
+    uint64_t total = 0;
+    for (int i = 0; i < BUCKETS; i++) {
+        counts[i] = buckets[i].load(std::memory_order_relaxed);
+        total += counts[i];
+    }
+    uint64_t largest = max.load(std::memory_order_relaxed);
+    
+    // Upper bound of the bucket holding the given fraction of values, capped at max
+    auto percentile = [&](double fraction) -> uint64_t {
+        uint64_t rank = (uint64_t)std::ceil(fraction * total);
+        uint64_t seen = 0;
+        for (int i = 0; i < BUCKETS; i++) {
+            seen += counts[i];
+            if (seen >= rank && counts[i] > 0) {
+                return std::min(largest, i == 0 ? 0 : (uint64_t(1) << i) - 1);
+            }
+        }
+        return largest;
+    };
+    
+    json bucketCounts = json::object();
+    for (int i = 0; i < BUCKETS; i++) {
+        if (counts[i] == 0) continue;
+        bucketCounts[std::to_string(i == 0 ? 0 : (uint64_t(1) << i) - 1)] = counts[i];
+    }
+    
+    return {
+        {"count", total},
+        {"sum", sum.load(std::memory_order_relaxed)},
+        {"max", largest},
+        {"p50", percentile(0.5)},
+        {"p90", percentile(0.9)},
+        {"p99", percentile(0.99)},
+        {"p999", percentile(0.999)},
+        {"buckets", bucketCounts}
+    };
+}
+
+// Metrics
+Metrics& Metrics::instance() {
+    static Metrics* metrics = new Metrics();
+    return *metrics;
+}
+
+std::atomic<uint64_t>& Metrics::counter(const std::string& name) {
+    std::lock_guard<std::mutex> lock(mutex);
+    auto& slot = counters[name];
+    if (!slot) {
+        slot.reset(new std::atomic<uint64_t>(0));
+    }
+    return *slot;
+}
+
+Histogram& Metrics::histogram(const std::string& name) {
+    std::lock_guard<std::mutex> lock(mutex);
+    auto& slot = histograms[name];
+    if (!slot) {
+        slot.reset(new Histogram());
+    }
+    return *slot;
+}
+
+json Metrics::snapshot() {
+    json result = {
+        {"uptime_seconds", std::chrono::duration_cast<std::chrono::seconds>(std::chrono::steady_clock::now() - started).count()},
+        {"counters", json::object()},
+        {"histograms", json::object()}
+    };
+    std::lock_guard<std::mutex> lock(mutex);
+    for (const auto& entry : counters) {
+        result["counters"][entry.first] = entry.second->load(std::memory_order_relaxed);
+    }
+    for (const auto& entry : histograms) {
+        result["histograms"][entry.first] = entry.second->toJson();
+    }
+    return result;
+}
+
+void countMetric(const std::string& name, uint64_t amount) {
+    Metrics::instance().counter(name).fetch_add(amount, std::memory_order_relaxed);
+}
+
+void recordMetric(const std::string& name, uint64_t value) {
+    Metrics::instance().histogram(name).record(value);
+}
+
+uint64_t elapsedMicros(std::chrono::steady_clock::time_point since) {
+    auto elapsed = std::chrono::steady_clock::now() - since;
+    return std::max<int64_t>(0, std::chrono::duration_cast<std::chrono::microseconds>(elapsed).count());
+}
+
+// Get CPU architecture
+std::string getCPUArch() {
+#if defined(__x86_64__) || defined(_M_X64)
+    return "x64";
+#elif defined(__aarch64__) || defined(_M_ARM64)
+    return "arm64";
+#else
+    return "x64"; // default
+#endif
+}
+
+// Callback for CURL to write data to string
+size_t writeCallback(void* contents, size_t size, size_t nmemb, std::string* output) {
+    size_t totalSize = size * nmemb;
+    output->append((char*)contents, totalSize);
+    return totalSize;
+}
+
+// A plain GET written to a file, hashed on the way when digest is set
+struct FileDownload {
+    FILE* fp = nullptr;
+    ArchiveDigest* digest = nullptr;
+    uint64_t written = 0;
+};
+
+// Callback for CURL to write data to file
+size_t writeFileCallback(void* ptr, size_t size, size_t nmemb, FileDownload* download) {
+    size_t totalSize = size * nmemb;
+    if (fwrite(ptr, 1, totalSize, download->fp) != totalSize) return 0;
+    if (download->digest) {
+        download->digest->written(fileno(download->fp), download->written, ptr, totalSize);
+    }
+    download->written += totalSize;
+    return totalSize;
+}
+
+// HttpClient
+HttpClient& HttpClient::instance() {
+    // Never destroyed: background threads may still be transferring at exit
+    static HttpClient* client = new HttpClient();
+    return *client;
+}
+
+HttpClient::HttpClient() : share(curl_share_init()) {
+    if (!share) {
+        throw std::runtime_error("Failed to initialize CURL share handle");
+    }
+    curl_share_setopt(share, CURLSHOPT_LOCKFUNC, lockShare);
+    curl_share_setopt(share, CURLSHOPT_UNLOCKFUNC, unlockShare);
+    curl_share_setopt(share, CURLSHOPT_USERDATA, this);
+    curl_share_setopt(share, CURLSHOPT_SHARE, CURL_LOCK_DATA_DNS);
+    curl_share_setopt(share, CURLSHOPT_SHARE, CURL_LOCK_DATA_SSL_SESSION);
+}
+
+void HttpClient::lockShare(CURL*, curl_lock_data data, curl_lock_access, void* client) {
+    static_cast<HttpClient*>(client)->shareLocks[data].lock();
+}
+
+void HttpClient::unlockShare(CURL*, curl_lock_data data, void* client) {
+    static_cast<HttpClient*>(client)->shareLocks[data].unlock();
+}
+
+CURL* HttpClient::acquire() {
+    CURL* curl = nullptr;
+    {
+        std::lock_guard<std::mutex> lock(poolMutex);
+        if (!idle.empty()) {
+            curl = idle.back();
+            idle.pop_back();
+        }
+    }
+    if (!curl) {
+        curl = curl_easy_init();
+        if (!curl) {
+            throw std::runtime_error("Failed to initialize CURL");
+        }
+    }
+    
+    curl_easy_setopt(curl, CURLOPT_SHARE, share);
+    curl_easy_setopt(curl, CURLOPT_NOSIGNAL, 1L);
+    curl_easy_setopt(curl, CURLOPT_FOLLOWLOCATION, 1L);
+    curl_easy_setopt(curl, CURLOPT_HTTP_VERSION, (long)CURL_HTTP_VERSION_2TLS);
+    curl_easy_setopt(curl, CURLOPT_TCP_KEEPALIVE, 1L);
+    return curl;
+}
+
+void HttpClient::release(CURL* curl) {
+    if (!curl) return;
+    
+    long responseCode = 0;
+    long newConnections = 0;
+    curl_easy_getinfo(curl, CURLINFO_RESPONSE_CODE, &responseCode);
+    curl_easy_getinfo(curl, CURLINFO_NUM_CONNECTS, &newConnections);
+    if (responseCode > 0) {
+        requests++;
+        connections += newConnections;
+    }
+    
+    // Reset drops per-transfer options; the handle keeps its connections alive for the next user
+    curl_easy_reset(curl);
+    std::lock_guard<std::mutex> lock(poolMutex);
+    if (idle.size() < HTTP_POOL_SIZE) {
+        idle.push_back(curl);
+    } else {
+        curl_easy_cleanup(curl);
+    }
+}
+
+CURLM* HttpClient::createMulti() {
+    CURLM* multi = curl_multi_init();
+    if (!multi) {
+        throw std::runtime_error("Failed to initialize CURL multi handle");
+    }
+    curl_multi_setopt(multi, CURLMOPT_PIPELINING, CURLPIPE_MULTIPLEX);
+    return multi;
+}
+
+HttpStats HttpClient::stats() {
+    HttpStats result;
+    result.requests = requests;
+    result.connections = connections;
+    return result;
+}
+
+// Whether version is safe to use as a directory name under the runtime directory
+bool isValidRuntimeVersion(const std::string& version) {
+    if (version.empty() || version == "." || version == "..") return false;
+    for (char c : version) {
+        if (!isalnum((unsigned char)c) && c != '.' && c != '_' && c != '-') return false;
+    }
+    return true;
+}
+
+// Parse runtime settings out of a manifest body
+Config parseConfig(const std::string& body) {
+    Config config;
+    auto jsonObj = json::parse(body);
+    config.version = jsonObj["runtime"]["version"].get<std::string>();
+    if (!config.version.empty() && !isValidRuntimeVersion(config.version)) {
+        throw std::runtime_error("Invalid runtime.version: " + config.version);
+    }
+    config.arguments = jsonObj["runtime"].value("arguments", "");
+    config.sha256 = jsonObj["runtime"].value("sha256", "");
+    std::transform(config.sha256.begin(), config.sha256.end(), config.sha256.begin(), ::tolower);
+    return config;
+}
+
+// Fetch config from URL
+Config fetchConfig(const std::string& url) {
+    auto results = fetchConfigs({url}, FetchOptions());
+    if (!results[0].ok) {
+        throw std::runtime_error(results[0].error);
+    }
+    return results[0].config;
+}
+
+std::string manifestCachePath(const std::string& cacheDir, const std::string& url) {
+    Sha256 hash;
+    hash.update(url.data(), url.size());
+    return cacheDir + "/" + hash.hexDigest() + ".json";
+}
+
+CachedManifest loadCachedManifest(const std::string& cacheDir, const std::string& url) {
+    CachedManifest cached;
+    std::ifstream in(manifestCachePath(cacheDir, url));
+    if (!in) return cached;
+    
+    try {
+        json entry = json::parse(in);
+        if (entry.value("url", "") != url) return cached;
+        cached.body = entry.at("body").get<std::string>();
+        cached.etag = entry.value("etag", "");
+        cached.lastModified = entry.value("lastModified", "");
+        cached.valid = true;
+    } catch (const std::exception&) {
+        // Unreadable entry; treated as a cache miss and overwritten by the next fetch
+    }
+    return cached;
+}
+
+// Written to a temp file and renamed so readers never see a partial entry
+void saveCachedManifest(const std::string& cacheDir, const std::string& url, const CachedManifest& cached) {
+    json entry;
+    entry["url"] = url;
+    entry["body"] = cached.body;
+    entry["etag"] = cached.etag;
+    entry["lastModified"] = cached.lastModified;
+    
+    try {
+        createDirectory(cacheDir);
+    } catch (const std::exception& e) {
+        logWithTimestamp(std::string("Manifest cache unavailable: ") + e.what());
+        return;
+    }
+    
+    std::string path = manifestCachePath(cacheDir, url);
+    std::string tmpPath = path + ".tmp." + std::to_string(getpid()) + "." +
+                          std::to_string(std::hash<std::thread::id>()(std::this_thread::get_id()));
+    {
+        std::ofstream out(tmpPath, std::ios::trunc);
+        out << entry.dump();
+        if (!out) {
+            unlink(tmpPath.c_str());
+            return;
+        }
+    }
+    if (rename(tmpPath.c_str(), path.c_str()) < 0) {
+        unlink(tmpPath.c_str());
+    }
+}
+
+// Collects ETag/Last-Modified of the final response into a CachedManifest
+size_t cacheHeaderCallback(char* buffer, size_t size, size_t nitems, CachedManifest* headers) {
+    size_t totalSize = size * nitems;
+    std::string line(buffer, totalSize);
+    size_t colon = line.find(':');
+    if (colon == std::string::npos) {
+        if (line.rfind("HTTP/", 0) == 0) {
+            headers->etag.clear();
+            headers->lastModified.clear();
+        }
+        return totalSize;
+    }
+    
+    std::string name = line.substr(0, colon);
+    std::transform(name.begin(), name.end(), name.begin(), ::tolower);
+    if (name == "etag") {
+        headers->etag = trim(line.substr(colon + 1));
+    } else if (name == "last-modified") {
+        headers->lastModified = trim(line.substr(colon + 1));
+    }
+    return totalSize;
+}
+
+// Fill result from the cached body; false if there is nothing usable
+bool useCachedManifest(FetchResult& result, const CachedManifest& cached) {
+    if (!cached.valid) return false;
+    try {
+        result.config = parseConfig(cached.body);
+    } catch (const std::exception&) {
+        return false;
+    }
+    result.ok = true;
+    result.fromCache = true;
+    result.error.clear();
+    return true;
+}
+
+// Fetch all manifests concurrently on a single curl multi handle.
+// Every request gets its own timeout; results are returned in input order, and are
+// also passed to onResult (on the calling thread) as soon as each one is final.
+// With a cache directory, requests carry If-None-Match/If-Modified-Since, a 304
+// answers from the cache, and a cached copy is used when the server is unreachable.
+std::vector<FetchResult> fetchConfigs(const std::vector<std::string>& urls, const FetchOptions& options,
+                                      const std::function<void(const FetchResult&)>& onResult) {
+    std::vector<FetchResult> results(urls.size());
+    std::vector<std::string> responses(urls.size());
+    std::vector<CURL*> handles(urls.size(), nullptr);
+    std::vector<curl_slist*> requestHeaders(urls.size(), nullptr);
+    std::vector<CachedManifest> cached(urls.size());
+    std::vector<CachedManifest> received(urls.size());
+    std::vector<std::string> revalidate;
+    std::vector<Config> served;
+    std::vector<bool> reported(urls.size(), false);
+    bool caching = !options.cacheDir.empty();
+    HttpClient& client = HttpClient::instance();
+    CURLM* multi = client.createMulti();
+    
+    for (size_t i = 0; i < urls.size(); i++) {
+        results[i].url = urls[i];
+        
+        if (caching) {
+            cached[i] = loadCachedManifest(options.cacheDir, urls[i]);
+            if (options.staleWhileRevalidate && useCachedManifest(results[i], cached[i])) {
+                revalidate.push_back(urls[i]);
+                served.push_back(results[i].config);
+                reported[i] = true;
+                if (onResult) onResult(results[i]);
+                continue;
+            }
+        }
+        
+        CURL* curl = client.acquire();
+        curl_easy_setopt(curl, CURLOPT_URL, urls[i].c_str());
+        curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, writeCallback);
+        curl_easy_setopt(curl, CURLOPT_WRITEDATA, &responses[i]);
+        curl_easy_setopt(curl, CURLOPT_TIMEOUT_MS, options.timeoutMs);
+        curl_easy_setopt(curl, CURLOPT_PRIVATE, (void*)i);
+        // Manifests are small JSON: compress them, and share one HTTP/2 connection per host
+        curl_easy_setopt(curl, CURLOPT_ACCEPT_ENCODING, "");
+        curl_easy_setopt(curl, CURLOPT_PIPEWAIT, 1L);
+        
+        if (caching) {
+            curl_easy_setopt(curl, CURLOPT_HEADERFUNCTION, cacheHeaderCallback);
+            curl_easy_setopt(curl, CURLOPT_HEADERDATA, &received[i]);
+            if (cached[i].valid) {
+                if (!cached[i].etag.empty()) {
+                    requestHeaders[i] = curl_slist_append(requestHeaders[i], ("If-None-Match: " + cached[i].etag).c_str());
+                }
+                if (!cached[i].lastModified.empty()) {
+                    requestHeaders[i] = curl_slist_append(requestHeaders[i],
+                                                          ("If-Modified-Since: " + cached[i].lastModified).c_str());
+                }
+                curl_easy_setopt(curl, CURLOPT_HTTPHEADER, requestHeaders[i]);
+            }
+        }
+        
+        handles[i] = curl;
+        curl_multi_add_handle(multi, curl);
+    }
+    
+    // Settle results[i] from a finished transfer
+    auto completeTransfer = [&](CURLMsg* msg, size_t i) {
+        FetchResult& result = results[i];
+        
+        curl_off_t totalTime = 0;
+        curl_easy_getinfo(msg->easy_handle, CURLINFO_TOTAL_TIME_T, &totalTime);
+        recordMetric("manifest_fetch_us", totalTime);
+        countMetric("manifest_fetches");
+        
+        if (msg->data.result != CURLE_OK) {
+            countMetric("manifest_fetch_errors");
+            result.error = std::string("CURL error: ") + curl_easy_strerror(msg->data.result);
+            if (useCachedManifest(result, cached[i])) {
+                logWithTimestamp("Using cached manifest for " + result.url + " (" +
+                                 curl_easy_strerror(msg->data.result) + ")");
+            }
+            return;
+        }
+        
+        long httpCode = 0;
+        curl_easy_getinfo(msg->easy_handle, CURLINFO_RESPONSE_CODE, &httpCode);
+        if (httpCode == 304 && useCachedManifest(result, cached[i])) {
+            countMetric("manifest_not_modified");
+            return;
+        }
+        if (httpCode != 200) {
+            countMetric("manifest_fetch_errors");
+            result.error = "HTTP error: " + std::to_string(httpCode);
+            if (httpCode >= 500 && useCachedManifest(result, cached[i])) {
+                logWithTimestamp("Using cached manifest for " + result.url + " (HTTP " +
+                                 std::to_string(httpCode) + ")");
+            }
+            return;
+        }
+        
+        try {
+            result.config = parseConfig(responses[i]);
+            result.ok = true;
+        } catch (const std::exception& e) {
+            result.error = std::string("Failed to parse config: ") + e.what();
+            return;
+        }
+        
+        if (caching) {
+            received[i].body = responses[i];
+            saveCachedManifest(options.cacheDir, result.url, received[i]);
+        }
+    };
+    
+    int running = 0;
+    do {
+        CURLMcode mc = curl_multi_perform(multi, &running);
+        if (mc == CURLM_OK && running > 0) {
+            mc = curl_multi_poll(multi, NULL, 0, 1000, NULL);
+        }
+        if (mc != CURLM_OK) {
+            logWithTimestamp(std::string("CURL multi error: ") + curl_multi_strerror(mc));
+            break;
+        }
+        
+        // Collect finished transfers as they complete
+        CURLMsg* msg;
+        int msgsLeft = 0;
+        while ((msg = curl_multi_info_read(multi, &msgsLeft))) {
+            if (msg->msg != CURLMSG_DONE) continue;
+            
+            void* priv = nullptr;
+            curl_easy_getinfo(msg->easy_handle, CURLINFO_PRIVATE, &priv);
+            size_t i = (size_t)priv;
+            completeTransfer(msg, i);
+            reported[i] = true;
+            if (onResult) onResult(results[i]);
+        }
+    } while (running > 0);
+    
+    for (size_t i = 0; i < handles.size(); i++) {
+        if (!handles[i]) continue;
+        if (!results[i].ok && results[i].error.empty()) {
+            results[i].error = "Transfer did not complete";
+        }
+        if (!reported[i] && onResult) onResult(results[i]);
+        curl_multi_remove_handle(multi, handles[i]);
+        client.release(handles[i]);
+        curl_slist_free_all(requestHeaders[i]);
+    }
+    curl_multi_cleanup(multi);
+    
+    if (!revalidate.empty()) {
+        FetchOptions refresh = options;
+        refresh.staleWhileRevalidate = false;
+        
+        // Refresh the cache for the next start; what is running now keeps the stale copy
+        std::thread([revalidate, refresh, served]() {
+            auto fresh = fetchConfigs(revalidate, refresh);
+            for (size_t i = 0; i < fresh.size(); i++) {
+                if (!fresh[i].ok) {
+                    logWithTimestamp("Background revalidation failed for " + fresh[i].url + ": " + fresh[i].error);
+                } else if (fresh[i].config.version != served[i].version ||
+                           fresh[i].config.arguments != served[i].arguments) {
+                    logWithTimestamp("Manifest changed for " + fresh[i].url + " (runtime " + served[i].version +
+                                     " -> " + fresh[i].config.version + "), takes effect on next start");
+                }
+            }
+        }).detach();
+    }
+    
+    return results;
+}
+
+// Create path and any missing parents (mkdir -p) without spawning a shell
+void createDirectory(const std::string& path) {
+    for (size_t pos = path.find('/', 1); ; pos = path.find('/', pos + 1)) {
+        std::string prefix = path.substr(0, pos);
+        if (!prefix.empty() && mkdir(prefix.c_str(), 0755) < 0 && errno != EEXIST) {
+            throw std::runtime_error("Failed to create directory: " + prefix + " (" + strerror(errno) + ")");
+        }
+        if (pos == std::string::npos) break;
+    }
+}
+
+// Delete path and everything below it; missing paths are ignored
+void removeDirectory(const std::string& path) {
+    DIR* dir = opendir(path.c_str());
+    if (!dir) {
+        unlink(path.c_str());
+        return;
+    }
+    while (struct dirent* entry = readdir(dir)) {
+        std::string name = entry->d_name;
+        if (name == "." || name == "..") continue;
+        std::string child = path + "/" + name;
+        bool isDir = entry->d_type == DT_DIR;
+        if (entry->d_type == DT_UNKNOWN) {
+            // Some filesystems leave the type out; symlinks to directories stay links
+            struct stat st;
+            isDir = fstatat(dirfd(dir), name.c_str(), &st, AT_SYMLINK_NOFOLLOW) == 0 && S_ISDIR(st.st_mode);
+        }
+        if (isDir) {
+            removeDirectory(child);
+        } else {
+            unlink(child.c_str());
+        }
+    }
+    closedir(dir);
+    rmdir(path.c_str());
+}
+
+// DirectoryCache
+DirectoryCache::DirectoryCache(const std::string& root) {
+    createDirectory(root);
+    rootFd = open(root.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (rootFd < 0) {
+        throw std::runtime_error("Failed to open directory: " + root);
+    }
+}
+
+DirectoryCache::~DirectoryCache() {
+    for (auto& entry : fds) {
+        close(entry.second);
+    }
+    close(rootFd);
+}
+
+int DirectoryCache::get(const std::string& relativeDir) {
+    std::lock_guard<std::mutex> lock(mutex);
+    return getLocked(relativeDir);
+}
+
+int DirectoryCache::getLocked(const std::string& relativeDir) {
+    if (relativeDir.empty()) return rootFd;
+    
+    auto it = fds.find(relativeDir);
+    if (it != fds.end()) return it->second;
+    
+    size_t pos = relativeDir.find_last_of('/');
+    int parentFd = getLocked(pos == std::string::npos ? "" : relativeDir.substr(0, pos));
+    if (parentFd < 0) return -1;
+    
+    std::string name = (pos == std::string::npos) ? relativeDir : relativeDir.substr(pos + 1);
+    if (mkdirat(parentFd, name.c_str(), 0755) < 0 && errno != EEXIST) {
+        return -1;
+    }
+    
+    int fd = openat(parentFd, name.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (fd < 0) return -1;
+    
+    fds[relativeDir] = fd;
+    return fd;
+}
+
+// Reject absolute paths and ".." components so entries cannot escape the target directory
+bool isSafeEntryName(const std::string& name) {
+    if (name.empty() || name[0] == '/') return false;
+    for (const auto& part : split(name, '/')) {
+        if (part == "..") return false;
+    }
+    return true;
+}
+
+// File mode for an extracted entry: executable if the archive says so, 0644 otherwise
+mode_t entryMode(zip_uint8_t opsys, zip_uint32_t attributes) {
+    if (opsys == ZIP_OPSYS_UNIX && ((attributes >> 16) & 0111)) {
+        return 0755;
+    }
+    return 0644;
+}
+
+// Current process umask, read once before any extraction thread starts
+static mode_t processUmask() {
+    static mode_t mask = [] {
+        mode_t m = umask(0);
+        umask(m);
+        return m;
+    }();
+    return mask;
+}
+
+// Create an extracted file relative to its cached parent directory with its final
+// mode, preallocated to its uncompressed size. Returns the descriptor or -1.
+int createExtractedFile(DirectoryCache& dirs, const std::string& name, uint64_t size, mode_t mode) {
+    size_t pos = name.find_last_of('/');
+    int dirFd = dirs.get(pos == std::string::npos ? "" : name.substr(0, pos));
+    if (dirFd < 0) return -1;
+    
+    std::string base = (pos == std::string::npos) ? name : name.substr(pos + 1);
+    int flags = O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC;
+    int fd = openat(dirFd, base.c_str(), flags, mode);
+    if (fd < 0 && errno == EEXIST) {
+        // Replace rather than truncate so the new mode is applied
+        unlinkat(dirFd, base.c_str(), 0);
+        fd = openat(dirFd, base.c_str(), flags, mode);
+    }
+    if (fd < 0) return -1;
+    
+    if (mode & processUmask()) {
+        fchmod(fd, mode);
+    }
+    if (size > 0) {
+        fallocate(fd, 0, 0, (off_t)size);
+    }
+    return fd;
+}
+
+// write() until everything is written
+bool writeAll(int fd, const char* data, size_t len) {
+    while (len > 0) {
+        ssize_t n = write(fd, data, len);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            return false;
+        }
+        data += n;
+        len -= n;
+    }
+    return true;
+}
+
+// Sha256
+Sha256::Sha256() : ctx(EVP_MD_CTX_new()) {
+    EVP_DigestInit_ex(ctx, EVP_sha256(), nullptr);
+}
+
+Sha256::~Sha256() {
+    EVP_MD_CTX_free(ctx);
+}
+
+void Sha256::update(const void* data, size_t len) {
+    EVP_DigestUpdate(ctx, data, len);
+}
+
+std::string Sha256::hexDigest() {
+    unsigned char digest[EVP_MAX_MD_SIZE];
+    unsigned int len = 0;
+    EVP_DigestFinal_ex(ctx, digest, &len);
+    
+    static const char* hex = "0123456789abcdef";
+    std::string out;
+    for (unsigned int i = 0; i < len; i++) {
+        out += hex[digest[i] >> 4];
+        out += hex[digest[i] & 0xf];
+    }
+    return out;
+}
+
+// ArchiveDigest
+void ArchiveDigest::written(int fd, uint64_t offset, const void* data, size_t len) {
+    uint64_t end = offset + len;
+    if (end <= hashed) return;
+    if (offset <= hashed) {
+        hash->update((const char*)data + (hashed - offset), end - hashed);
+        hashed = end;
+        catchUp(fd, 0);
+        return;
+    }
+    present(offset, end);
+}
+
+void ArchiveDigest::present(uint64_t offset, uint64_t end) {
+    // Extend the range this one continues, so sequential writes stay a single entry
+    auto next = ahead.lower_bound(offset);
+    if (next != ahead.begin()) {
+        auto previous = std::prev(next);
+        if (previous->second == offset) {
+            previous->second = std::max(previous->second, end);
+            return;
+        }
+    }
+    uint64_t& known = ahead[offset];
+    known = std::max(known, end);
+}
+
+void ArchiveDigest::reset() {
+    hash.reset(new Sha256());
+    hashed = 0;
+    ahead.clear();
+}
+
+// Hash the remembered ranges that now continue the prefix, and up to end if it is
+// further; false if fd could not be read
+bool ArchiveDigest::catchUp(int fd, uint64_t end) {
+    std::vector<char> buf;
+    auto readUpTo = [&](uint64_t until) {
+        if (buf.empty()) buf.resize(1024 * 1024);
+        while (hashed < until) {
+            size_t want = (size_t)std::min<uint64_t>(until - hashed, buf.size());
+            ssize_t n = pread(fd, buf.data(), want, (off_t)hashed);
+            if (n < 0 && errno == EINTR) continue;
+            if (n <= 0) return false;
+            hash->update(buf.data(), n);
+            hashed += n;
+        }
+        return true;
+    };
+    
+    while (!ahead.empty() && ahead.begin()->first <= hashed) {
+        uint64_t until = ahead.begin()->second;
+        ahead.erase(ahead.begin());
+        if (until > hashed && !readUpTo(until)) return false;
+    }
+    return end <= hashed || readUpTo(end);
+}
+
+std::string ArchiveDigest::finish(int fd, uint64_t size) {
+    if (!catchUp(fd, size)) {
+        throw std::runtime_error(std::string("Failed to read back download for hashing: ") + strerror(errno));
+    }
+    return hash->hexDigest();
+}
+
+// ObjectStore
+ObjectStore::ObjectStore(const std::string& root) : root(root), dirs(root) {
+    tmpDirFd = dirs.get("tmp");
+    if (tmpDirFd < 0 || dirs.get("index") < 0) {
+        throw std::runtime_error("Failed to initialize object store: " + root);
+    }
+    loadIndexes();
+}
+
+std::string ObjectStore::knownKey(const std::string& path, uint64_t size, uint32_t crc) {
+    return path + "\n" + std::to_string(size) + ":" + std::to_string(crc);
+}
+
+void ObjectStore::loadIndexes() {
+    std::string indexDir = root + "/index";
+    DIR* dir = opendir(indexDir.c_str());
+    if (!dir) return;
+    
+    while (struct dirent* entry = readdir(dir)) {
+        std::string fileName = entry->d_name;
+        if (fileName.size() <= 5 || fileName.compare(fileName.size() - 5, 5, ".json") != 0) continue;
+        
+        try {
+            std::ifstream in(indexDir + "/" + fileName);
+            json index = json::parse(in);
+            for (const auto& file : index["files"]) {
+                if (file.value("mode", 0644) != 0644) continue;
+                known[knownKey(file["path"], file["size"], file["crc32"])] = file["sha256"];
+            }
+        } catch (const std::exception& e) {
+            logWithTimestamp("Ignoring unreadable store index " + fileName + ": " + e.what());
+        }
+    }
+    closedir(dir);
+}
+
+std::string ObjectStore::findKnown(const std::string& path, uint64_t size, uint32_t crc) {
+    auto it = known.find(knownKey(path, size, crc));
+    return it == known.end() ? "" : it->second;
+}
+
+int ObjectStore::openObject(const std::string& sha256) {
+    int objectDirFd = dirs.get(sha256.substr(0, 2));
+    if (objectDirFd < 0) return -1;
+    return openat(objectDirFd, sha256.c_str(), O_RDONLY | O_CLOEXEC);
+}
+
+int ObjectStore::createTemp(std::string& tmpName, uint64_t size) {
+    tmpName = std::to_string(getpid()) + "-" + std::to_string(tmpCounter++);
+    int fd = openat(tmpDirFd, tmpName.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd < 0) return -1;
+    
+    if (0644 & processUmask()) {
+        fchmod(fd, 0644);
+    }
+    if (size > 0) {
+        fallocate(fd, 0, 0, (off_t)size);
+    }
+    return fd;
+}
+
+void ObjectStore::discardTemp(const std::string& tmpName) {
+    unlinkat(tmpDirFd, tmpName.c_str(), 0);
+}
+
+bool ObjectStore::commitTemp(const std::string& tmpName, const std::string& sha256) {
+    int objectDirFd = dirs.get(sha256.substr(0, 2));
+    if (objectDirFd < 0) {
+        discardTemp(tmpName);
+        return false;
+    }
+    
+    // An existing object with the same digest wins; the duplicate is dropped
+    bool ok = linkat(tmpDirFd, tmpName.c_str(), objectDirFd, sha256.c_str(), 0) == 0 || errno == EEXIST;
+    discardTemp(tmpName);
+    return ok;
+}
+
+bool ObjectStore::materialize(const std::string& sha256, DirectoryCache& target, const std::string& name) {
+    int objectDirFd = dirs.get(sha256.substr(0, 2));
+    size_t pos = name.find_last_of('/');
+    int dirFd = target.get(pos == std::string::npos ? "" : name.substr(0, pos));
+    std::string base = (pos == std::string::npos) ? name : name.substr(pos + 1);
+    if (objectDirFd < 0 || dirFd < 0) return false;
+    
+    if (reflinks) {
+        int src = openat(objectDirFd, sha256.c_str(), O_RDONLY | O_CLOEXEC);
+        if (src < 0) return false;
+        
+        int dst = createExtractedFile(target, name, 0, 0644);
+        if (dst >= 0) {
+            int rc = ioctl(dst, FICLONE, src);
+            int cloneErrno = errno;
+            close(dst);
+            if (rc == 0) {
+                close(src);
+                return true;
+            }
+            unlinkat(dirFd, base.c_str(), 0);
+            if (cloneErrno == EOPNOTSUPP || cloneErrno == ENOTTY || cloneErrno == EXDEV ||
+                cloneErrno == EINVAL || cloneErrno == ENOSYS) {
+                reflinks = false;
+            }
+        }
+        close(src);
+    }
+    
+    if (linkat(objectDirFd, sha256.c_str(), dirFd, base.c_str(), 0) == 0) return true;
+    if (errno != EEXIST) return false;
+    
+    unlinkat(dirFd, base.c_str(), 0);
+    return linkat(objectDirFd, sha256.c_str(), dirFd, base.c_str(), 0) == 0;
+}
+
+bool ObjectStore::detach(DirectoryCache& target, const std::string& name, mode_t mode) {
+    size_t pos = name.find_last_of('/');
+    int dirFd = target.get(pos == std::string::npos ? "" : name.substr(0, pos));
+    std::string base = (pos == std::string::npos) ? name : name.substr(pos + 1);
+    if (dirFd < 0) return false;
+    
+    int src = openat(dirFd, base.c_str(), O_RDONLY | O_CLOEXEC);
+    if (src < 0) return false;
+    
+    struct stat st;
+    fstat(src, &st);
+    std::string copyName = name + ".rvm-detach";
+    int dst = createExtractedFile(target, copyName, st.st_size, mode);
+    if (dst < 0) {
+        close(src);
+        return false;
+    }
+    
+    bool ok = true;
+    off_t remaining = st.st_size;
+    while (remaining > 0) {
+        ssize_t n = copy_file_range(src, nullptr, dst, nullptr, remaining, 0);
+        if (n <= 0) {
+            ok = false;
+            break;
+        }
+        remaining -= n;
+    }
+    close(src);
+    close(dst);
+    
+    std::string copyBase = base + ".rvm-detach";
+    if (!ok || renameat(dirFd, copyBase.c_str(), dirFd, base.c_str()) < 0) {
+        unlinkat(dirFd, copyBase.c_str(), 0);
+        return false;
+    }
+    
+    std::lock_guard<std::mutex> lock(mutex);
+    auto it = recorded.find(name);
+    if (it != recorded.end()) {
+        it->second.mode = mode;
+    }
+    return true;
+}
+
+bool ObjectStore::adopt(DirectoryCache& target, const std::string& name, const std::string& sha256) {
+    int objectDirFd = dirs.get(sha256.substr(0, 2));
+    size_t pos = name.find_last_of('/');
+    int dirFd = target.get(pos == std::string::npos ? "" : name.substr(0, pos));
+    std::string base = (pos == std::string::npos) ? name : name.substr(pos + 1);
+    if (objectDirFd < 0 || dirFd < 0) return false;
+    
+    if (linkat(dirFd, base.c_str(), objectDirFd, sha256.c_str(), 0) == 0) return true;
+    return errno == EEXIST && materialize(sha256, target, name);
+}
+
+void ObjectStore::record(const StoredFile& file) {
+    std::lock_guard<std::mutex> lock(mutex);
+    recorded[file.path] = file;
+}
+
+void ObjectStore::writeIndex(const std::string& version) {
+    json files = json::array();
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        for (const auto& entry : recorded) {
+            const StoredFile& file = entry.second;
+            files.push_back({
+                {"path", file.path},
+                {"size", file.size},
+                {"crc32", file.crc},
+                {"mode", file.mode},
+                {"sha256", file.sha256}
+            });
+        }
+        recorded.clear();
+    }
+    
+    json index = {{"version", version}, {"files", files}};
+    std::string indexPath = root + "/index/" + version + ".json";
+    std::string tmpPath = indexPath + ".tmp";
+    {
+        std::ofstream out(tmpPath);
+        out << index.dump();
+        if (!out) {
+            throw std::runtime_error("Failed to write store index: " + tmpPath);
+        }
+    }
+    rename(tmpPath.c_str(), indexPath.c_str());
+}
+
+// InstallIndex
+void InstallIndex::record(const std::string& path, uint64_t size, uint32_t crc) {
+    std::lock_guard<std::mutex> lock(mutex);
+    files[path] = {size, crc};
+}
+
+void InstallIndex::write(const std::string& versionDir) {
+    json entries = json::array();
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        for (const auto& entry : files) {
+            entries.push_back({
+                {"path", entry.first},
+                {"size", entry.second.first},
+                {"crc32", entry.second.second}
+            });
+        }
+    }
+    
+    std::string indexPath = versionDir + "/" + INSTALL_INDEX_FILE;
+    std::ofstream out(indexPath);
+    out << json({{"files", entries}}).dump();
+    if (!out) {
+        throw std::runtime_error("Failed to write install index: " + indexPath);
+    }
+}
+
+// Output for one extracted file. Without an object store the file is written in
+// place; with one it is hashed while written and, unless executable, committed to
+// the store and linked into the version directory. Given a candidate object (see
+// ObjectStore::findKnown), the data is compared with it instead of written, and the
+// object is linked only if the SHA-256 of the data is the candidate's. At the first
+// difference the matching prefix is copied from the object and writing takes over.
+class EntryOutput {
+public:
+    EntryOutput(DirectoryCache& dirs, ObjectStore* store, InstallIndex* index, const std::string& name,
+                uint64_t size, mode_t mode, const std::string& candidate = "")
+        : dirs(dirs), store(store), index(index), name(name), mode(mode), allocated(size) {
+        if (store) {
+            hash.reset(new Sha256());
+        }
+        if (store && !(mode & 0111) && !candidate.empty()) {
+            objectFd = store->openObject(candidate);
+            if (objectFd >= 0) {
+                this->candidate = candidate;
+                return;
+            }
+        }
+        if (store && !(mode & 0111)) {
+            fd = store->createTemp(tmpName, size);
+        } else {
+            fd = createExtractedFile(dirs, name, size, mode);
+        }
+    }
+    
+    ~EntryOutput() {
+        if (fd >= 0) close(fd);
+        if (objectFd >= 0) close(objectFd);
+        if (!tmpName.empty()) store->discardTemp(tmpName);
+    }
+    
+    bool isOpen() const { return fd >= 0 || objectFd >= 0; }
+    bool writeFailed() const { return failed; }
+    
+    bool write(const char* data, size_t len) {
+        if (failed) return false;
+        if (objectFd >= 0) {
+            if (matchesObject(data, len)) {
+                hash->update(data, len);
+                crc = crc32(crc, (const Bytef*)data, (uInt)len);
+                written += len;
+                return true;
+            }
+            if (!startWriting()) {
+                failed = true;
+                return false;
+            }
+        }
+        if (fd < 0) return false;
+        if (!writeAll(fd, data, len)) {
+            failed = true;
+            return false;
+        }
+        if (hash) hash->update(data, len);
+        crc = crc32(crc, (const Bytef*)data, (uInt)len);
+        written += len;
+        return true;
+    }
+    
+    // Finish the file. size and crc are what the archive says it holds; the file is only
+    // kept (and indexed) if the bytes actually written match both.
+    bool commit(uint32_t expectedCrc, uint64_t size) {
+        std::string sha256 = hash ? hash->hexDigest() : "";
+        if (objectFd >= 0) {
+            if (written != size || crc != expectedCrc) return false;
+            if (sha256 == candidate && store->materialize(candidate, dirs, name)) {
+                if (index) index->record(name, written, (uint32_t)crc);
+                store->record({name, written, (uint32_t)crc, mode, sha256});
+                return true;
+            }
+            // Same bytes, but the object is longer or cannot be linked: keep a copy of our own
+            if (!startWriting()) return false;
+        }
+        if (fd < 0) return false;
+        // Preallocation made the file its full size; cut it back to what really got written
+        if (written != allocated) {
+            ftruncate(fd, (off_t)written);
+        }
+        close(fd);
+        fd = -1;
+        if (failed || written != size || crc != expectedCrc) return false;
+        if (index) index->record(name, written, (uint32_t)crc);
+        if (!store) return true;
+        
+        if (!tmpName.empty()) {
+            bool ok = store->commitTemp(tmpName, sha256) && store->materialize(sha256, dirs, name);
+            tmpName.clear();
+            if (!ok) return false;
+        }
+        store->record({name, written, (uint32_t)crc, mode, sha256});
+        return true;
+    }
+    
+private:
+    DirectoryCache& dirs;
+    ObjectStore* store;
+    InstallIndex* index;
+    std::string name;
+    mode_t mode;
+    uint64_t allocated;
+    int fd = -1;
+    uint64_t written = 0;
+    uLong crc = crc32(0L, Z_NULL, 0);
+    bool failed = false;
+    std::string tmpName;
+    std::unique_ptr<Sha256> hash;
+    std::string candidate;
+    int objectFd = -1;
+    std::vector<char> objectBuf;
+    
+    bool matchesObject(const char* data, size_t len) {
+        if (objectBuf.size() < len) objectBuf.resize(len);
+        size_t done = 0;
+        while (done < len) {
+            ssize_t n = pread(objectFd, objectBuf.data() + done, len - done, (off_t)(written + done));
+            if (n <= 0) return false;
+            done += n;
+        }
+        return memcmp(objectBuf.data(), data, len) == 0;
+    }
+    
+    // Stop comparing: write what matched so far, copied from the candidate object, to a
+    // file of our own
+    bool startWriting() {
+        int src = objectFd;
+        objectFd = -1;
+        fd = store->createTemp(tmpName, allocated);
+        bool ok = fd >= 0;
+        loff_t offset = 0;
+        while (ok && (uint64_t)offset < written) {
+            ssize_t n = copy_file_range(src, &offset, fd, nullptr, written - offset, 0);
+            ok = n > 0;
+        }
+        close(src);
+        return ok;
+    }
+};
+
+// Extract a single file entry from an open archive; throws if it cannot be written in full
+void extractZipEntry(zip* za, zip_uint64_t index, DirectoryCache& dirs, ObjectStore* store,
+                     InstallIndex* installIndex, const std::string& name, uint64_t size, uint32_t crc,
+                     mode_t mode, std::vector<char>& buf) {
+    // A file another version stored under the same path, size and CRC is checked
+    // against while inflating rather than written again
+    std::string candidate = store ? store->findKnown(name, size, crc) : "";
+    
+    zip_file* zf = zip_fopen_index(za, index, 0);
+    if (!zf) {
+        throw std::runtime_error("Failed to open zip entry: " + name);
+    }
+    
+    EntryOutput output(dirs, store, installIndex, name, size, mode, candidate);
+    if (!output.isOpen()) {
+        zip_fclose(zf);
+        throw std::runtime_error("Failed to create file: " + name);
+    }
+    
+    zip_int64_t bytesRead;
+    bool written = true;
+    while ((bytesRead = zip_fread(zf, buf.data(), buf.size())) > 0) {
+        if (!output.write(buf.data(), bytesRead)) {
+            written = false;
+            break;
+        }
+    }
+    // libzip reports a CRC mismatch or a damaged entry as a read error
+    std::string readError = bytesRead < 0 ? zip_file_strerror(zf) : "";
+    zip_fclose(zf);
+    
+    if (!readError.empty()) {
+        throw std::runtime_error("Failed to read zip entry " + name + ": " + readError);
+    }
+    if (!written || !output.commit(crc, size)) {
+        throw std::runtime_error((output.writeFailed() ? "Failed to write file: " : "Checksum mismatch in ") + name);
+    }
+}
+
+// Extract zip file.
+// Directories are created up front, then file entries are spread over a pool of
+// workers (largest first), each reading through its own zip handle.
+void extractZip(const std::string& zipPath, const std::string& destDir, int threads,
+                ObjectStore* store, InstallIndex* index) {
+    int err = 0;
+    zip* za = zip_open(zipPath.c_str(), 0, &err);
+    
+    if (!za) {
+        throw std::runtime_error("Failed to open zip file");
+    }
+    
+    std::unique_ptr<DirectoryCache> dirs;
+    try {
+        dirs.reset(new DirectoryCache(destDir));
+    } catch (...) {
+        zip_close(za);
+        throw;
+    }
+    processUmask();
+    
+    struct FileEntry {
+        zip_uint64_t index;
+        zip_uint64_t size;
+        uint32_t crc;
+        mode_t mode;
+        std::string name;
+    };
+    std::vector<FileEntry> files;
+    
+    zip_int64_t numEntries = zip_get_num_entries(za, 0);
+    
+    for (zip_int64_t i = 0; i < numEntries; i++) {
+        struct zip_stat st;
+        zip_stat_init(&st);
+        zip_stat_index(za, i, 0, &st);
+        
+        std::string name = st.name;
+        if (!isSafeEntryName(name)) {
+            logWithTimestamp("Skipping unsafe zip entry: " + name);
+            continue;
+        }
+        
+        // Check if it's a directory
+        if (name.back() == '/') {
+            dirs->get(name.substr(0, name.size() - 1));
+            continue;
+        }
+        
+        zip_uint8_t opsys = 0;
+        zip_uint32_t attributes = 0;
+        zip_file_get_external_attributes(za, i, 0, &opsys, &attributes);
+        
+        files.push_back({(zip_uint64_t)i, st.size, st.crc, entryMode(opsys, attributes), name});
+    }
+    
+    // Schedule large entries first so one big file does not finish last on a single core
+    std::stable_sort(files.begin(), files.end(), [](const FileEntry& a, const FileEntry& b) {
+        return a.size > b.size;
+    });
+    
+    if (threads <= 0) {
+        threads = std::max(1u, std::thread::hardware_concurrency());
+    }
+    threads = std::max(1, std::min<int>(threads, (int)files.size()));
+    
+    std::atomic<size_t> next(0);
+    DirectoryCache& dirCache = *dirs;
+    // The first failure stops the other workers and is rethrown once they are done
+    std::string failure;
+    std::mutex failureMutex;
+    auto worker = [&files, &next, &dirCache, store, index, &failure, &failureMutex](zip* handle) {
+        std::vector<char> buf(EXTRACT_BUFFER_SIZE);
+        size_t i;
+        while ((i = next.fetch_add(1)) < files.size()) {
+            const FileEntry& entry = files[i];
+            try {
+                extractZipEntry(handle, entry.index, dirCache, store, index, entry.name, entry.size,
+                                entry.crc, entry.mode, buf);
+            } catch (const std::exception& e) {
+                std::lock_guard<std::mutex> lock(failureMutex);
+                if (failure.empty()) failure = e.what();
+                next = files.size();
+            }
+        }
+    };
+    
+    if (threads == 1) {
+        worker(za);
+        zip_close(za);
+        if (!failure.empty()) {
+            throw std::runtime_error(failure);
+        }
+        return;
+    }
+    
+    // libzip handles are not thread safe: every worker opens the archive itself
+    std::vector<std::thread> workers;
+    std::vector<zip*> handles;
+    for (int t = 0; t < threads; t++) {
+        zip* handle = zip_open(zipPath.c_str(), ZIP_RDONLY, &err);
+        if (!handle) break;
+        handles.push_back(handle);
+        workers.emplace_back(worker, handle);
+    }
+    if (workers.empty()) {
+        worker(za);
+    }
+    
+    for (auto& w : workers) {
+        w.join();
+    }
+    for (zip* handle : handles) {
+        zip_close(handle);
+    }
+    zip_close(za);
+    if (!failure.empty()) {
+        throw std::runtime_error(failure);
+    }
+}
+
+// StreamBuffer
+bool StreamBuffer::write(const char* data, size_t len) {
+    std::unique_lock<std::mutex> lock(mutex);
+    while (len > 0) {
+        notFull.wait(lock, [this] { return used < buffer.size() || aborted; });
+        if (aborted) return false;
+        
+        size_t tail = (head + used) % buffer.size();
+        size_t chunk = std::min(len, std::min(buffer.size() - used, buffer.size() - tail));
+        memcpy(&buffer[tail], data, chunk);
+        used += chunk;
+        data += chunk;
+        len -= chunk;
+        notEmpty.notify_one();
+    }
+    return true;
+}
+
+size_t StreamBuffer::read(char* data, size_t len) {
+    std::unique_lock<std::mutex> lock(mutex);
+    notEmpty.wait(lock, [this] { return used > 0 || finished || aborted; });
+    if (used == 0) return 0;
+    
+    size_t chunk = std::min(len, std::min(used, buffer.size() - head));
+    memcpy(data, &buffer[head], chunk);
+    head = (head + chunk) % buffer.size();
+    used -= chunk;
+    notFull.notify_one();
+    return chunk;
+}
+
+void StreamBuffer::finish() {
+    std::lock_guard<std::mutex> lock(mutex);
+    finished = true;
+    notEmpty.notify_all();
+}
+
+void StreamBuffer::abort() {
+    std::lock_guard<std::mutex> lock(mutex);
+    aborted = true;
+    notFull.notify_all();
+    notEmpty.notify_all();
+}
+
+// Sequential reader over a StreamBuffer, used to walk zip local headers in order
+struct ZipStreamReader {
+    StreamBuffer& input;
+    std::vector<char> buf = std::vector<char>(256 * 1024);
+    size_t pos = 0;
+    size_t len = 0;
+    
+    explicit ZipStreamReader(StreamBuffer& in) : input(in) {}
+    
+    // Ensure at least one unread byte is buffered; false at end of stream
+    bool fill() {
+        if (pos < len) return true;
+        pos = 0;
+        len = input.read(buf.data(), buf.size());
+        return len > 0;
+    }
+    
+    void readExact(void* out, size_t n) {
+        char* dst = (char*)out;
+        while (n > 0) {
+            if (!fill()) throw std::runtime_error("Unexpected end of archive stream");
+            size_t chunk = std::min(n, len - pos);
+            memcpy(dst, &buf[pos], chunk);
+            pos += chunk;
+            dst += chunk;
+            n -= chunk;
+        }
+    }
+    
+    void skip(uint64_t n) {
+        while (n > 0) {
+            if (!fill()) throw std::runtime_error("Unexpected end of archive stream");
+            size_t chunk = (size_t)std::min<uint64_t>(n, len - pos);
+            pos += chunk;
+            n -= chunk;
+        }
+    }
+    
+    uint16_t u16() { unsigned char b[2]; readExact(b, 2); return b[0] | (b[1] << 8); }
+    uint32_t u32() { uint32_t lo = u16(); return lo | ((uint32_t)u16() << 16); }
+    uint64_t u64() { uint64_t lo = u32(); return lo | ((uint64_t)u32() << 32); }
+};
+
+// Extract a zip archive as it arrives, walking the local file headers in stream order.
+// Entries stored without a known size (stored + data descriptor) cannot be streamed
+// and cause an exception so the caller can fall back to the file based path.
+// Local headers carry no permissions, so files are created 0644 and executables are
+// fixed up from the central directory once it arrives at the end of the stream.
+void extractZipStream(StreamBuffer& input, const std::string& destDir, ObjectStore* store,
+                      InstallIndex* index) {
+    ZipStreamReader reader(input);
+    DirectoryCache dirs(destDir);
+    processUmask();
+    std::vector<char> outBuf(EXTRACT_BUFFER_SIZE);
+    size_t fileCount = 0;
+    uint32_t signature;
+    
+    while (true) {
+        signature = reader.u32();
+        if (signature != 0x04034b50) {
+            // Central directory (or end record) follows the last entry
+            if (signature != 0x02014b50 && signature != 0x06054b50 && signature != 0x06064b50) {
+                throw std::runtime_error("Invalid zip stream: unexpected signature");
+            }
+            break;
+        }
+        
+        reader.u16(); // version needed
+        uint16_t flags = reader.u16();
+        uint16_t method = reader.u16();
+        reader.u32(); // modification time and date
+        uint32_t crc = reader.u32();
+        uint64_t compSize = reader.u32();
+        uint64_t size = reader.u32();
+        uint16_t nameLen = reader.u16();
+        uint16_t extraLen = reader.u16();
+        
+        std::string name(nameLen, '\0');
+        reader.readExact(&name[0], nameLen);
+        std::vector<unsigned char> extra(extraLen);
+        reader.readExact(extra.data(), extraLen);
+        
+        // Zip64 sizes live in extra field 0x0001
+        bool zip64 = false;
+        for (size_t p = 0; p + 4 <= extra.size();) {
+            uint16_t id = extra[p] | (extra[p + 1] << 8);
+            uint16_t sz = extra[p + 2] | (extra[p + 3] << 8);
+            if (id == 0x0001) {
+                zip64 = true;
+                size_t q = p + 4;
+                auto rd64 = [&](size_t at) {
+                    uint64_t v = 0;
+                    for (int b = 7; b >= 0; b--) v = (v << 8) | extra[at + b];
+                    return v;
+                };
+                if (size == 0xFFFFFFFF && q + 8 <= p + 4 + sz) { size = rd64(q); q += 8; }
+                if (compSize == 0xFFFFFFFF && q + 8 <= p + 4 + sz) { compSize = rd64(q); }
+            }
+            p += 4 + sz;
+        }
+        
+        if (flags & 0x1) {
+            throw std::runtime_error("Encrypted zip entries are not supported: " + name);
+        }
+        bool hasDescriptor = (flags & 0x8) != 0;
+        if (method != 0 && method != 8) {
+            throw std::runtime_error("Unsupported compression method for streaming: " + name);
+        }
+        bool isDir = !name.empty() && name.back() == '/';
+        if (method == 0 && hasDescriptor && compSize == 0 && !isDir) {
+            throw std::runtime_error("Cannot stream stored entry without size: " + name);
+        }
+        
+        if (!isSafeEntryName(name)) {
+            throw std::runtime_error("Unsafe zip entry: " + name);
+        }
+        
+        std::unique_ptr<EntryOutput> output;
+        if (isDir) {
+            dirs.get(name.substr(0, name.size() - 1));
+        } else {
+            // Without a descriptor the size and CRC are known up front, so a stored candidate
+            // can be checked against instead of writing the file again
+            std::string candidate = store && !hasDescriptor ? store->findKnown(name, size, crc) : "";
+            output.reset(new EntryOutput(dirs, store, index, name, hasDescriptor ? 0 : size, 0644, candidate));
+            if (!output->isOpen()) {
+                throw std::runtime_error("Failed to create file: " + name);
+            }
+        }
+        
+        // EntryOutput checksums what it writes, so the data is only read here
+        if (method == 0) {
+            uint64_t remaining = compSize;
+            while (remaining > 0) {
+                size_t chunk = (size_t)std::min<uint64_t>(remaining, outBuf.size());
+                reader.readExact(outBuf.data(), chunk);
+                if (output) output->write(outBuf.data(), chunk);
+                remaining -= chunk;
+            }
+        } else {
+            z_stream zs;
+            memset(&zs, 0, sizeof(zs));
+            if (inflateInit2(&zs, -MAX_WBITS) != Z_OK) {
+                throw std::runtime_error("Failed to initialize inflate");
+            }
+            
+            int ret = Z_OK;
+            while (ret != Z_STREAM_END) {
+                if (!reader.fill()) {
+                    inflateEnd(&zs);
+                    throw std::runtime_error("Unexpected end of archive stream in " + name);
+                }
+                zs.next_in = (Bytef*)&reader.buf[reader.pos];
+                zs.avail_in = (uInt)(reader.len - reader.pos);
+                zs.next_out = (Bytef*)outBuf.data();
+                zs.avail_out = (uInt)outBuf.size();
+            
+                ret = inflate(&zs, Z_NO_FLUSH);
+                if (ret != Z_OK && ret != Z_STREAM_END) {
+                    inflateEnd(&zs);
+                    throw std::runtime_error("Corrupt deflate data in " + name);
+                }
+            
+                reader.pos = reader.len - zs.avail_in;
+                size_t produced = outBuf.size() - zs.avail_out;
+                if (output && produced > 0) output->write(outBuf.data(), produced);
+            }
+            inflateEnd(&zs);
+        }
+        
+        if (hasDescriptor) {
+            uint32_t first = reader.u32();
+            crc = (first == 0x08074b50) ? reader.u32() : first;
+            if (zip64) {
+                reader.u64(); // compressed size
+                size = reader.u64();
+            } else {
+                reader.u32(); // compressed size
+                size = reader.u32();
+            }
+        }
+        
+        if (output) {
+            if (!output->commit(crc, size)) {
+                throw std::runtime_error((output->writeFailed() ? "Failed to write file: " :
+                                          "Checksum mismatch while streaming ") + name);
+            }
+            fileCount++;
+        }
+    }
+    
+    // Apply executable bits recorded in the central directory
+    while (signature == 0x02014b50) {
+        uint16_t versionMadeBy = reader.u16();
+        reader.skip(2 + 2 + 2 + 4 + 4 + 4 + 4); // version needed, flags, method, time, crc, sizes
+        uint16_t nameLen = reader.u16();
+        uint16_t extraLen = reader.u16();
+        uint16_t commentLen = reader.u16();
+        reader.skip(2 + 2); // disk number, internal attributes
+        uint32_t attributes = reader.u32();
+        reader.u32(); // local header offset
+        
+        std::string name(nameLen, '\0');
+        reader.readExact(&name[0], nameLen);
+        reader.skip(extraLen + commentLen);
+        
+        mode_t mode = entryMode(versionMadeBy >> 8, attributes);
+        if (mode != 0644 && !name.empty() && name.back() != '/' && isSafeEntryName(name)) {
+            size_t pos = name.find_last_of('/');
+            int dirFd = dirs.get(pos == std::string::npos ? "" : name.substr(0, pos));
+            std::string base = (pos == std::string::npos) ? name : name.substr(pos + 1);
+            if (store) {
+                // The file may be a link into the store, which must keep its mode
+                store->detach(dirs, name, mode);
+            } else if (dirFd >= 0) {
+                fchmodat(dirFd, base.c_str(), mode, 0);
+            }
+        }
+        
+        signature = reader.u32();
+    }
+    
+    // Drain the end records so the downloader is never blocked on a full buffer
+    while (reader.fill()) {
+        reader.pos = reader.len;
+    }
+    
+    logWithTimestamp("Streamed " + std::to_string(fileCount) + " file(s) to: " + destDir);
+}
+
+// A download feeding the streaming extractor, hashed on the way when digest is set
+struct StreamDownload {
+    StreamBuffer* stream = nullptr;
+    ArchiveDigest* digest = nullptr;
+    uint64_t written = 0;
+};
+
+// Callback for CURL to feed downloaded bytes into the extraction pipeline
+size_t writeStreamCallback(void* ptr, size_t size, size_t nmemb, StreamDownload* download) {
+    size_t totalSize = size * nmemb;
+    if (download->digest) {
+        download->digest->written(-1, download->written, ptr, totalSize);
+        download->written += totalSize;
+    }
+    return download->stream->write((const char*)ptr, totalSize) ? totalSize : 0;
+}
+
+// Download the runtime and extract it concurrently through a bounded in-memory buffer
+void downloadAndStreamRuntime(const std::string& downloadURL, const std::string& targetDir,
+                              ObjectStore* store, InstallIndex* index, ArchiveDigest* digest) {
+    CURL* curl = HttpClient::instance().acquire();
+    StreamBuffer stream(STREAM_BUFFER_SIZE);
+    StreamDownload download;
+    download.stream = &stream;
+    download.digest = digest;
+    std::string extractError;
+    std::thread extractor([&stream, &targetDir, &extractError, store, index]() {
+        try {
+            extractZipStream(stream, targetDir, store, index);
+        } catch (const std::exception& e) {
+            extractError = e.what();
+            stream.abort();
+        }
+    });
+    
+    curl_easy_setopt(curl, CURLOPT_URL, downloadURL.c_str());
+    curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, writeStreamCallback);
+    curl_easy_setopt(curl, CURLOPT_WRITEDATA, &download);
+    curl_easy_setopt(curl, CURLOPT_FAILONERROR, 1L);
+    
+    CURLcode res = curl_easy_perform(curl);
+    stream.finish();
+    extractor.join();
+    
+    long httpCode = 0;
+    curl_easy_getinfo(curl, CURLINFO_RESPONSE_CODE, &httpCode);
+    HttpClient::instance().release(curl);
+    
+    // An error response leaves the extractor with an empty stream, so it must win over
+    // the extraction error; a failed write after an extraction error must not
+    if (res != CURLE_OK && httpCode >= 400) {
+        throw HttpError("HTTP error: " + std::to_string(httpCode));
+    }
+    if (!extractError.empty()) {
+        throw std::runtime_error("Streaming extraction failed: " + extractError);
+    }
+    if (res != CURLE_OK) {
+        throw std::runtime_error(std::string("Download failed: ") + curl_easy_strerror(res));
+    }
+}
+
+// Header callback collecting Accept-Ranges / ETag / Last-Modified from a probe
+size_t probeHeaderCallback(char* buffer, size_t size, size_t nitems, RemoteFileInfo* info) {
+    size_t totalSize = size * nitems;
+    std::string line(buffer, totalSize);
+    size_t colon = line.find(':');
+    if (colon == std::string::npos) {
+        // Status line of a new response (e.g. after a redirect) resets what we know
+        if (line.rfind("HTTP/", 0) == 0) {
+            info->acceptsRanges = false;
+            info->validator.clear();
+        }
+        return totalSize;
+    }
+    
+    std::string name = line.substr(0, colon);
+    std::transform(name.begin(), name.end(), name.begin(), ::tolower);
+    std::string value = trim(line.substr(colon + 1));
+    
+    if (name == "accept-ranges") {
+        info->acceptsRanges = (value.find("bytes") != std::string::npos);
+    } else if (name == "etag") {
+        info->validator = value;
+    } else if (name == "last-modified" && info->validator.empty()) {
+        info->validator = value;
+    }
+    return totalSize;
+}
+
+// HEAD the URL to learn its size and whether byte ranges are supported
+RemoteFileInfo probeRemoteFile(const std::string& url) {
+    RemoteFileInfo info;
+    CURL* curl = HttpClient::instance().acquire();
+    curl_easy_setopt(curl, CURLOPT_URL, url.c_str());
+    curl_easy_setopt(curl, CURLOPT_NOBODY, 1L);
+    curl_easy_setopt(curl, CURLOPT_HEADERFUNCTION, probeHeaderCallback);
+    curl_easy_setopt(curl, CURLOPT_HEADERDATA, &info);
+    
+    CURLcode res = curl_easy_perform(curl);
+    long httpCode = 0;
+    curl_easy_getinfo(curl, CURLINFO_RESPONSE_CODE, &httpCode);
+    curl_easy_getinfo(curl, CURLINFO_CONTENT_LENGTH_DOWNLOAD_T, &info.size);
+    HttpClient::instance().release(curl);
+    
+    if (res != CURLE_OK || httpCode != 200) {
+        // Not fatal: the plain GET will report the real error
+        info.size = -1;
+        info.acceptsRanges = false;
+    }
+    return info;
+}
+
+// Progress callback of downloads that give way to application launches
+static int yieldToLaunchesCallback(void*, curl_off_t, curl_off_t, curl_off_t, curl_off_t) {
+    return LaunchPipeline::launching() ? 1 : 0;
+}
+
+// Apply limits to curl, one of connections transfers making up a download
+static void limitTransfer(CURL* curl, const DownloadLimits& limits, int connections) {
+    if (limits.maxBytesPerSec > 0) {
+        curl_easy_setopt(curl, CURLOPT_MAX_RECV_SPEED_LARGE,
+                         std::max<curl_off_t>(1, limits.maxBytesPerSec / std::max(1, connections)));
+    }
+    if (limits.yieldToLaunches) {
+        curl_easy_setopt(curl, CURLOPT_XFERINFOFUNCTION, yieldToLaunchesCallback);
+        curl_easy_setopt(curl, CURLOPT_NOPROGRESS, 0L);
+    }
+}
+
+// Plain single-connection GET of url into path
+void downloadSingle(const std::string& url, const std::string& path, const DownloadLimits& limits,
+                    ArchiveDigest* digest) {
+    FileDownload download;
+    download.fp = fopen(path.c_str(), "wb");
+    download.digest = digest;
+    if (!download.fp) {
+        throw std::runtime_error("Failed to create temporary file");
+    }
+    if (digest) {
+        digest->reset();
+    }
+    
+    CURL* curl = HttpClient::instance().acquire();
+    curl_easy_setopt(curl, CURLOPT_URL, url.c_str());
+    curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, writeFileCallback);
+    curl_easy_setopt(curl, CURLOPT_WRITEDATA, &download);
+    limitTransfer(curl, limits, 1);
+    
+    CURLcode res = curl_easy_perform(curl);
+    fclose(download.fp);
+    
+    long httpCode = 0;
+    curl_easy_getinfo(curl, CURLINFO_RESPONSE_CODE, &httpCode);
+    HttpClient::instance().release(curl);
+    
+    if (res == CURLE_ABORTED_BY_CALLBACK) {
+        unlink(path.c_str());
+        throw DownloadYielded("Download stopped for application launches");
+    }
+    if (res != CURLE_OK) {
+        unlink(path.c_str());
+        throw std::runtime_error(std::string("Download failed: ") + curl_easy_strerror(res));
+    }
+    
+    if (httpCode != 200) {
+        unlink(path.c_str());
+        throw HttpError("HTTP error: " + std::to_string(httpCode));
+    }
+}
+
+// One in-flight HTTP Range request of a ranged download
+struct ChunkTransfer {
+    CURL* curl = nullptr;
+    int fd = -1;
+    ArchiveDigest* digest = nullptr;
+    size_t index = 0;
+    uint64_t offset = 0;
+    uint64_t end = 0;       // exclusive
+    uint64_t written = 0;
+    int attempts = 0;
+    bool overflow = false;
+    std::string range;
+};
+
+// Callback for CURL to write a chunk at its position in the archive
+size_t writeChunkCallback(void* ptr, size_t size, size_t nmemb, ChunkTransfer* chunk) {
+    size_t totalSize = size * nmemb;
+    uint64_t position = chunk->offset + chunk->written;
+    if (position + totalSize > chunk->end) {
+        // Server ignored the Range header and is sending the whole file
+        chunk->overflow = true;
+        return 0;
+    }
+    
+    const char* data = (const char*)ptr;
+    size_t left = totalSize;
+    while (left > 0) {
+        ssize_t n = pwrite(chunk->fd, data, left, (off_t)position);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            return 0;
+        }
+        data += n;
+        position += n;
+        left -= n;
+    }
+    if (chunk->digest) {
+        chunk->digest->written(chunk->fd, chunk->offset + chunk->written, ptr, totalSize);
+    }
+    chunk->written += totalSize;
+    return totalSize;
+}
+
+// Persist which chunks are complete so an interrupted download can resume
+void saveDownloadState(const std::string& statePath, const std::string& url, const RemoteFileInfo& info,
+                       const std::vector<bool>& done) {
+    json state = {
+        {"url", url},
+        {"size", info.size},
+        {"validator", info.validator},
+        {"chunkSize", DOWNLOAD_CHUNK_SIZE},
+        {"done", done}
+    };
+    
+    std::string tmpPath = statePath + ".tmp";
+    {
+        std::ofstream out(tmpPath);
+        out << state.dump();
+    }
+    rename(tmpPath.c_str(), statePath.c_str());
+}
+
+// Completed chunks recorded by a previous run, if it was downloading the same file
+std::vector<bool> loadDownloadState(const std::string& statePath, const std::string& url,
+                                    const RemoteFileInfo& info, size_t chunkCount) {
+    std::vector<bool> done(chunkCount, false);
+    std::ifstream in(statePath);
+    if (!in) return done;
+    
+    try {
+        json state = json::parse(in);
+        if (state["url"] == url && state["size"] == info.size && state["validator"] == info.validator &&
+            state["chunkSize"] == DOWNLOAD_CHUNK_SIZE && state["done"].size() == chunkCount) {
+            done = state["done"].get<std::vector<bool>>();
+        }
+    } catch (const std::exception& e) {
+        logWithTimestamp("Ignoring unreadable download state " + statePath + ": " + e.what());
+    }
+    return done;
+}
+
+// Fetch url into path as DOWNLOAD_CHUNK_SIZE byte ranges over up to `connections`
+// parallel connections, recording finished chunks in <path>.state. Returns false if
+// the server turned out not to honour ranges, so the caller can fall back.
+bool downloadRanged(const std::string& url, const std::string& path, const RemoteFileInfo& info,
+                    int connections, const DownloadLimits& limits, ArchiveDigest* digest) {
+    std::string statePath = path + ".state";
+    size_t chunkCount = (size_t)((info.size + DOWNLOAD_CHUNK_SIZE - 1) / DOWNLOAD_CHUNK_SIZE);
+    std::vector<bool> done = loadDownloadState(statePath, url, info, chunkCount);
+    
+    size_t alreadyDone = std::count(done.begin(), done.end(), true);
+    if (alreadyDone > 0) {
+        logWithTimestamp("Resuming download: " + std::to_string(alreadyDone) + "/" +
+                         std::to_string(chunkCount) + " chunk(s) already present");
+    }
+    
+    // Readable too, so the digest can catch up on chunks that arrived out of order
+    int fd = open(path.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+    if (fd < 0) {
+        throw std::runtime_error("Failed to create temporary file");
+    }
+    if (alreadyDone == 0) {
+        ftruncate(fd, 0);
+        fallocate(fd, 0, 0, (off_t)info.size);
+    }
+    
+    std::vector<size_t> pending;
+    for (size_t i = 0; i < chunkCount; i++) {
+        if (!done[i]) {
+            pending.push_back(i);
+        } else if (digest) {
+            digest->present(i * DOWNLOAD_CHUNK_SIZE, std::min<uint64_t>((i + 1) * DOWNLOAD_CHUNK_SIZE, info.size));
+        }
+    }
+    
+    HttpClient& client = HttpClient::instance();
+    CURLM* multi = client.createMulti();
+    std::vector<std::unique_ptr<ChunkTransfer>> chunks;
+    size_t nextPending = 0;
+    int active = 0;
+    bool rangesIgnored = false;
+    bool httpFailure = false;
+    bool yielded = false;
+    std::string failure;
+    
+    auto startChunk = [&](ChunkTransfer* chunk) {
+        chunk->written = 0;
+        chunk->attempts++;
+        CURL* curl = client.acquire();
+        curl_easy_setopt(curl, CURLOPT_URL, url.c_str());
+        curl_easy_setopt(curl, CURLOPT_RANGE, chunk->range.c_str());
+        curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, writeChunkCallback);
+        curl_easy_setopt(curl, CURLOPT_WRITEDATA, chunk);
+        curl_easy_setopt(curl, CURLOPT_PRIVATE, chunk);
+        limitTransfer(curl, limits, connections);
+        curl_multi_add_handle(multi, curl);
+        chunk->curl = curl;
+        active++;
+    };
+    
+    auto startNext = [&]() {
+        while (active < connections && nextPending < pending.size() && failure.empty()) {
+            size_t index = pending[nextPending++];
+            std::unique_ptr<ChunkTransfer> chunk(new ChunkTransfer);
+            chunk->fd = fd;
+            chunk->digest = digest;
+            chunk->index = index;
+            chunk->offset = index * DOWNLOAD_CHUNK_SIZE;
+            chunk->end = std::min<uint64_t>(chunk->offset + DOWNLOAD_CHUNK_SIZE, info.size);
+            chunk->range = std::to_string(chunk->offset) + "-" + std::to_string(chunk->end - 1);
+            startChunk(chunk.get());
+            chunks.push_back(std::move(chunk));
+        }
+    };
+    
+    startNext();
+    while (active > 0) {
+        int running = 0;
+        CURLMcode mc = curl_multi_perform(multi, &running);
+        if (mc == CURLM_OK && running > 0) {
+            mc = curl_multi_poll(multi, NULL, 0, 1000, NULL);
+        }
+        if (mc != CURLM_OK) {
+            failure = std::string("CURL multi error: ") + curl_multi_strerror(mc);
+            break;
+        }
+        
+        CURLMsg* msg;
+        int msgsLeft = 0;
+        while ((msg = curl_multi_info_read(multi, &msgsLeft))) {
+            if (msg->msg != CURLMSG_DONE) continue;
+            
+            CURL* curl = msg->easy_handle;
+            ChunkTransfer* chunk = nullptr;
+            curl_easy_getinfo(curl, CURLINFO_PRIVATE, (void**)&chunk);
+            long httpCode = 0;
+            curl_easy_getinfo(curl, CURLINFO_RESPONSE_CODE, &httpCode);
+            CURLcode result = msg->data.result;
+            curl_multi_remove_handle(multi, curl);
+            client.release(curl);
+            chunk->curl = nullptr;
+            active--;
+            
+            if (chunk->overflow || (result == CURLE_OK && httpCode == 200)) {
+                rangesIgnored = true;
+                failure = "server ignored Range request";
+            } else if (result == CURLE_OK && httpCode == 206 &&
+                       chunk->written == chunk->end - chunk->offset) {
+                fdatasync(fd);
+                done[chunk->index] = true;
+                saveDownloadState(statePath, url, info, done);
+            } else if (httpCode >= 400 && httpCode != 416) {
+                httpFailure = true;
+                failure = "HTTP error: " + std::to_string(httpCode);
+            } else if (result == CURLE_ABORTED_BY_CALLBACK) {
+                yielded = true;
+                failure = "Download stopped for application launches";
+            } else if (chunk->attempts < DOWNLOAD_CHUNK_ATTEMPTS) {
+                logWithTimestamp("Retrying chunk " + std::to_string(chunk->index) + " (" +
+                                 curl_easy_strerror(result) + ")");
+                startChunk(chunk);
+            } else {
+                failure = std::string("Download failed: ") + curl_easy_strerror(result);
+            }
+        }
+        
+        if (!failure.empty()) break;
+        startNext();
+    }
+    
+    // Abort whatever is still running after a failure
+    for (auto& chunk : chunks) {
+        if (chunk->curl) {
+            curl_multi_remove_handle(multi, chunk->curl);
+            client.release(chunk->curl);
+        }
+    }
+    curl_multi_cleanup(multi);
+    close(fd);
+    
+    if (rangesIgnored) {
+        unlink(statePath.c_str());
+        return false;
+    }
+    if (!failure.empty()) {
+        if (httpFailure) {
+            throw HttpError(failure);
+        }
+        if (yielded) {
+            throw DownloadYielded(failure + " (progress kept for resume)");
+        }
+        throw std::runtime_error(failure + " (progress kept for resume)");
+    }
+    
+    unlink(statePath.c_str());
+    return true;
+}
+
+// Download url into path, using parallel ranged requests when the server allows it
+void downloadArchive(const std::string& url, const std::string& path, int connections,
+                     const DownloadLimits& limits, ArchiveDigest* digest) {
+    RemoteFileInfo info = probeRemoteFile(url);
+    
+    if (info.acceptsRanges && info.size > 0) {
+        logWithTimestamp("Downloading " + std::to_string(info.size) + " bytes over " +
+                         std::to_string(connections) + " connection(s)");
+        if (downloadRanged(url, path, info, std::max(1, connections), limits, digest)) {
+            return;
+        }
+        logWithTimestamp("Server does not honour byte ranges, falling back to a single connection");
+    }
+    
+    downloadSingle(url, path, limits, digest);
+}
+
+// Fetch the digest published next to a runtime archive as <url>.sha256
+// ("<hex digest>" optionally followed by a file name, as written by sha256sum)
+std::string fetchPublishedDigest(const std::string& url) {
+    std::string body;
+    CURL* curl = HttpClient::instance().acquire();
+    std::string digestURL = url + ".sha256";
+    curl_easy_setopt(curl, CURLOPT_URL, digestURL.c_str());
+    curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, writeCallback);
+    curl_easy_setopt(curl, CURLOPT_WRITEDATA, &body);
+    curl_easy_setopt(curl, CURLOPT_TIMEOUT_MS, DEFAULT_FETCH_TIMEOUT_MS);
+    CURLcode res = curl_easy_perform(curl);
+    long httpCode = 0;
+    curl_easy_getinfo(curl, CURLINFO_RESPONSE_CODE, &httpCode);
+    HttpClient::instance().release(curl);
+    
+    if (res != CURLE_OK) {
+        throw std::runtime_error("Failed to fetch " + digestURL + ": " + curl_easy_strerror(res));
+    }
+    if (httpCode != 200) {
+        throw HttpError("HTTP error " + std::to_string(httpCode) + " fetching " + digestURL);
+    }
+    
+    std::string digest = body.substr(0, body.find_first_of(" \t\r\n"));
+    std::transform(digest.begin(), digest.end(), digest.begin(), ::tolower);
+    if (digest.size() != 64 || digest.find_first_not_of("0123456789abcdef") != std::string::npos) {
+        throw std::runtime_error("Invalid digest in " + digestURL);
+    }
+    return digest;
+}
+
+static void checkArchiveDigest(const std::string& actual, const std::string& expected) {
+    if (actual == expected) return;
+    countMetric("runtime_digest_failures");
+    throw DigestMismatch("Runtime archive failed SHA-256 verification (expected " + expected +
+                         ", got " + actual + ")");
+}
+
+// One file listed in a version's install index
+struct IndexedFile {
+    std::string path;
+    uint64_t size;
+    uint32_t crc;
+};
+
+// Files listed in versionDir's install index; none if it has no index
+static std::vector<IndexedFile> readInstallIndex(const std::string& versionDir) {
+    std::vector<IndexedFile> files;
+    std::ifstream in(versionDir + "/" + INSTALL_INDEX_FILE);
+    if (!in) return files;
+    
+    json index = json::parse(in);
+    for (const auto& file : index.at("files")) {
+        files.push_back({file.at("path"), file.at("size"), file.at("crc32")});
+    }
+    return files;
+}
+
+// CRC-32 of a whole file
+static bool fileCrc32(const std::string& path, uint32_t& crc, std::vector<char>& buf) {
+    int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) return false;
+    uLong value = crc32(0L, Z_NULL, 0);
+    ssize_t n;
+    while ((n = read(fd, buf.data(), buf.size())) > 0) {
+        value = crc32(value, (const Bytef*)buf.data(), (uInt)n);
+    }
+    close(fd);
+    crc = (uint32_t)value;
+    return n == 0;
+}
+
+static bool fileSha256(const std::string& path, std::string& sha256, std::vector<char>& buf) {
+    int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) return false;
+    Sha256 hash;
+    ssize_t n;
+    while ((n = read(fd, buf.data(), buf.size())) > 0) {
+        hash.update(buf.data(), n);
+    }
+    close(fd);
+    sha256 = hash.hexDigest();
+    return n == 0;
+}
+
+// Check an installed version against the index written when it was extracted. Quick
+// mode only compares sizes; full mode also recomputes every CRC-32, spread over all
+// cores. Versions installed before indexes existed have none and always pass.
+bool verifyInstalledRuntime(const std::string& versionDir, bool full, std::string& problem) {
+    problem.clear();
+    std::vector<IndexedFile> files;
+    try {
+        files = readInstallIndex(versionDir);
+    } catch (const std::exception& e) {
+        problem = "unreadable " + INSTALL_INDEX_FILE + ": " + e.what();
+        return false;
+    }
+    
+    for (const auto& file : files) {
+        struct stat st;
+        std::string path = versionDir + "/" + file.path;
+        if (stat(path.c_str(), &st) != 0) {
+            problem = file.path + " is missing";
+            return false;
+        }
+        if ((uint64_t)st.st_size != file.size) {
+            problem = file.path + " has size " + std::to_string(st.st_size) + ", expected " +
+                      std::to_string(file.size);
+            return false;
+        }
+    }
+    if (!full) return true;
+    
+    std::atomic<size_t> next(0);
+    std::mutex problemMutex;
+    auto worker = [&]() {
+        std::vector<char> buf(EXTRACT_BUFFER_SIZE);
+        size_t i;
+        while ((i = next.fetch_add(1)) < files.size()) {
+            const IndexedFile& file = files[i];
+            uint32_t crc = 0;
+            bool readable = fileCrc32(versionDir + "/" + file.path, crc, buf);
+            if (!readable || crc != file.crc) {
+                std::lock_guard<std::mutex> lock(problemMutex);
+                problem = file.path + (!readable ? " is unreadable" : " does not match its CRC-32");
+                next = files.size();
+            }
+        }
+    };
+    
+    int threads = std::max(1, std::min<int>(std::thread::hardware_concurrency(), (int)files.size()));
+    std::vector<std::thread> workers;
+    for (int t = 1; t < threads; t++) {
+        workers.emplace_back(worker);
+    }
+    worker();
+    for (auto& w : workers) {
+        w.join();
+    }
+    return problem.empty();
+}
+
+// Download and extract a runtime into stagingDir; version names the object store index
+static void installRuntime(const std::string& downloadURL, const std::string& stagingDir,
+                           const std::string& version, const InstallOptions& options) {
+    std::unique_ptr<ObjectStore> store;
+    if (!options.objectStoreDir.empty()) {
+        store.reset(new ObjectStore(options.objectStoreDir));
+    }
+    auto installStart = std::chrono::steady_clock::now();
+    countMetric("runtime_installs");
+    
+    // The archive is hashed as it arrives, so checking it costs no extra pass
+    std::string expectedSha256 = options.expectedSha256;
+    if (expectedSha256.empty() && options.publishedDigest) {
+        expectedSha256 = fetchPublishedDigest(downloadURL);
+    }
+    bool verify = !expectedSha256.empty();
+    InstallIndex index;
+    
+    if (options.streaming) {
+        logWithTimestamp("Streaming runtime from: " + downloadURL + " to: " + stagingDir);
+        try {
+            ArchiveDigest digest;
+            downloadAndStreamRuntime(downloadURL, stagingDir, store.get(), &index, verify ? &digest : nullptr);
+            if (verify) {
+                checkArchiveDigest(digest.finish(-1, 0), expectedSha256);
+            }
+            index.write(stagingDir);
+            if (store) {
+                store->writeIndex(version);
+            }
+            recordMetric("runtime_install_us", elapsedMicros(installStart));
+            return;
+        } catch (const HttpError&) {
+            throw;
+        } catch (const DigestMismatch&) {
+            throw;
+        } catch (const std::exception& e) {
+            logWithTimestamp("Streaming install failed (" + std::string(e.what()) + "), retrying with temporary file");
+            removeDirectory(stagingDir);
+        }
+    }
+    
+    logWithTimestamp("Downloading runtime from: " + downloadURL);
+    
+    // A stable name under downloadDir lets an interrupted download resume on the next run
+    std::string tmpFile;
+    if (!options.downloadDir.empty()) {
+        createDirectory(options.downloadDir);
+        tmpFile = options.downloadDir + "/" + version + ".zip";
+    } else {
+        char tmpName[] = "/tmp/openfin-runtime-XXXXXX.zip";
+        int tmpFd = mkstemps(tmpName, 4);
+        if (tmpFd < 0) {
+            throw std::runtime_error(std::string("Failed to create temporary file: ") + strerror(errno));
+        }
+        close(tmpFd);
+        tmpFile = tmpName;
+    }
+    
+    auto downloadStart = std::chrono::steady_clock::now();
+    ArchiveDigest digest;
+    downloadArchive(downloadURL, tmpFile, options.downloadConnections, options.limits, verify ? &digest : nullptr);
+    uint64_t downloadMicros = elapsedMicros(downloadStart);
+    
+    struct stat st;
+    st.st_size = 0;
+    if (stat(tmpFile.c_str(), &st) == 0) {
+        countMetric("runtime_download_bytes", st.st_size);
+        recordMetric("runtime_download_bytes_per_sec", (uint64_t)st.st_size * 1000000 / std::max<uint64_t>(1, downloadMicros));
+    }
+    recordMetric("runtime_download_us", downloadMicros);
+    
+    if (verify) {
+        // Only chunks kept from an earlier run are read back here
+        int fd = open(tmpFile.c_str(), O_RDONLY | O_CLOEXEC);
+        std::string actual;
+        try {
+            actual = digest.finish(fd, (uint64_t)st.st_size);
+        } catch (...) {
+            if (fd >= 0) close(fd);
+            throw;
+        }
+        if (fd >= 0) close(fd);
+        if (actual != expectedSha256) {
+            // Nothing of this download can be trusted for a resume
+            unlink(tmpFile.c_str());
+            unlink((tmpFile + ".state").c_str());
+        }
+        checkArchiveDigest(actual, expectedSha256);
+        logWithTimestamp("Verified runtime archive SHA-256 " + actual);
+    }
+    
+    logWithTimestamp("Downloaded runtime to: " + tmpFile);
+    
+    // Create staging directory
+    createDirectory(stagingDir);
+    
+    // Extract
+    logWithTimestamp("Extracting runtime to: " + stagingDir);
+    auto extractStart = std::chrono::steady_clock::now();
+    extractZip(tmpFile, stagingDir, options.extractThreads, store.get(), &index);
+    recordMetric("runtime_extract_us", elapsedMicros(extractStart));
+    
+    unlink(tmpFile.c_str());
+    index.write(stagingDir);
+    if (store) {
+        store->writeIndex(version);
+    }
+    recordMetric("runtime_install_us", elapsedMicros(installStart));
+}
+
+// Reads the decompressed contents of a runtime delta package
+class DeltaReader {
+public:
+    explicit DeltaReader(const std::string& path) : gz(gzopen(path.c_str(), "rb")) {
+        if (!gz) {
+            throw std::runtime_error("Failed to open runtime delta: " + path);
+        }
+        gzbuffer(gz, EXTRACT_BUFFER_SIZE);
+    }
+    
+    ~DeltaReader() {
+        gzclose(gz);
+    }
+    
+    void readExact(void* data, size_t len) {
+        char* out = (char*)data;
+        while (len > 0) {
+            int n = gzread(gz, out, (unsigned)std::min<size_t>(len, 1 << 30));
+            if (n <= 0) {
+                throw std::runtime_error("Truncated or corrupt runtime delta");
+            }
+            out += n;
+            len -= n;
+        }
+    }
+    
+    uint8_t u8() {
+        uint8_t b;
+        readExact(&b, 1);
+        return b;
+    }
+    
+    uint32_t u32() {
+        unsigned char b[4];
+        readExact(b, 4);
+        return b[0] | (b[1] << 8) | (b[2] << 16) | ((uint32_t)b[3] << 24);
+    }
+    
+    uint64_t u64() {
+        uint64_t low = u32();
+        return low | ((uint64_t)u32() << 32);
+    }
+    
+private:
+    gzFile gz;
+};
+
+// Put a copy of the base version's unchanged file into the new version: a reflink
+// where supported, else a plain copy. Inodes are only ever shared through the object
+// store, which keeps executables out.
+static bool reuseBaseFile(const std::string& basePath, DirectoryCache& dirs, const std::string& name,
+                          mode_t mode, std::vector<char>& buf) {
+    int src = open(basePath.c_str(), O_RDONLY | O_CLOEXEC);
+    if (src < 0) return false;
+    int dst = createExtractedFile(dirs, name, 0, mode);
+    if (dst < 0) {
+        close(src);
+        return false;
+    }
+    if (ioctl(dst, FICLONE, src) == 0) {
+        close(dst);
+        close(src);
+        return true;
+    }
+    
+    ssize_t n = 0;
+    bool ok = true;
+    while (ok && (n = read(src, buf.data(), buf.size())) > 0) {
+        ok = writeAll(dst, buf.data(), n);
+    }
+    close(dst);
+    close(src);
+    return ok && n == 0;
+}
+
+// Write one "data" or "patch" file of a delta, checking it against the header's size and CRC
+static void writeDeltaFile(DeltaReader& reader, DirectoryCache& dirs, const std::string& path,
+                           const std::string& basePath, bool patch, uint64_t size, uint32_t crc,
+                           mode_t mode, std::vector<char>& buf) {
+    int fd = createExtractedFile(dirs, path, size, mode);
+    if (fd < 0) {
+        throw std::runtime_error("Failed to create file: " + path);
+    }
+    int baseFd = -1;
+    
+    try {
+        uLong actual = crc32(0L, Z_NULL, 0);
+        uint64_t written = 0;
+        auto emit = [&](size_t len) {
+            if (written + len > size || !writeAll(fd, buf.data(), len)) {
+                throw std::runtime_error("Failed to write " + path + " from the runtime delta");
+            }
+            actual = crc32(actual, (const Bytef*)buf.data(), (uInt)len);
+            written += len;
+        };
+        
+        if (!patch) {
+            for (uint64_t left = size; left > 0;) {
+                size_t len = (size_t)std::min<uint64_t>(left, buf.size());
+                reader.readExact(buf.data(), len);
+                emit(len);
+                left -= len;
+            }
+        } else {
+            baseFd = open(basePath.c_str(), O_RDONLY | O_CLOEXEC);
+            if (baseFd < 0) {
+                throw std::runtime_error("Base version has no " + path + " to patch");
+            }
+            uint8_t instruction;
+            while ((instruction = reader.u8()) != DELTA_END) {
+                if (instruction == DELTA_COPY) {
+                    uint64_t offset = reader.u64();
+                    for (uint32_t left = reader.u32(); left > 0;) {
+                        ssize_t n = pread(baseFd, buf.data(), std::min<size_t>(left, buf.size()), (off_t)offset);
+                        if (n <= 0) {
+                            throw std::runtime_error("Patch for " + path + " reads past the end of its base file");
+                        }
+                        emit(n);
+                        offset += n;
+                        left -= n;
+                    }
+                } else if (instruction == DELTA_ADD) {
+                    for (uint32_t left = reader.u32(); left > 0;) {
+                        size_t len = std::min<size_t>(left, buf.size());
+                        reader.readExact(buf.data(), len);
+                        emit(len);
+                        left -= len;
+                    }
+                } else {
+                    throw std::runtime_error("Invalid patch instruction for " + path);
+                }
+            }
+        }
+        
+        if (written != size || actual != crc) {
+            throw std::runtime_error(path + " does not match the runtime delta after patching");
+        }
+    } catch (...) {
+        close(fd);
+        if (baseFd >= 0) close(baseFd);
+        throw;
+    }
+    close(fd);
+    if (baseFd >= 0) close(baseFd);
+}
+
+// Build version `to` in stagingDir from version `from` installed in baseDir and a
+// downloaded delta package. Every file is checked against the size and CRC-32 in the
+// delta header, so the result is as trustworthy as an extracted archive. With a store,
+// the built files are hashed and recorded like extracted ones.
+void applyRuntimeDelta(const std::string& deltaPath, const std::string& baseDir, const std::string& from,
+                       const std::string& stagingDir, const std::string& to, InstallIndex& index,
+                       ObjectStore* store) {
+    DeltaReader reader(deltaPath);
+    char magic[sizeof(DELTA_MAGIC)];
+    reader.readExact(magic, sizeof(magic));
+    if (memcmp(magic, DELTA_MAGIC, sizeof(magic)) != 0) {
+        throw std::runtime_error("Not a runtime delta: " + deltaPath);
+    }
+    uint32_t format = reader.u32();
+    if (format != DELTA_FORMAT_VERSION) {
+        throw std::runtime_error("Unsupported runtime delta format " + std::to_string(format));
+    }
+    uint32_t headerSize = reader.u32();
+    if (headerSize > MAX_DELTA_HEADER_SIZE) {
+        throw std::runtime_error("Runtime delta header of " + std::to_string(headerSize) + " bytes is too large");
+    }
+    std::string headerText(headerSize, '\0');
+    reader.readExact(&headerText[0], headerText.size());
+    json header = json::parse(headerText);
+    if (header.value("from", "") != from || header.value("to", "") != to) {
+        throw std::runtime_error("Runtime delta is for " + header.value("from", "?") + " -> " +
+                                 header.value("to", "?") + ", not " + from + " -> " + to);
+    }
+    
+    // Unchanged files are trusted when the base version's own index vouches for them
+    std::unordered_map<std::string, IndexedFile> baseFiles;
+    try {
+        for (const auto& file : readInstallIndex(baseDir)) {
+            baseFiles[file.path] = file;
+        }
+    } catch (const std::exception& e) {
+        logWithTimestamp("Ignoring unreadable index of " + baseDir + ": " + e.what());
+    }
+    
+    DirectoryCache dirs(stagingDir);
+    processUmask();
+    std::vector<char> buf(EXTRACT_BUFFER_SIZE);
+    
+    for (const auto& file : header.at("files")) {
+        std::string path = file.at("path");
+        std::string op = file.at("op");
+        uint64_t size = file.at("size");
+        uint32_t crc = file.at("crc32");
+        mode_t mode = (mode_t)file.value("mode", 0644) & 0777;
+        if (!isSafeEntryName(path) || path == INSTALL_INDEX_FILE) {
+            throw std::runtime_error("Unsafe path in runtime delta: " + path);
+        }
+        std::string basePath = baseDir + "/" + path;
+        // Digest of the file, once known, and whether it is already linked to its object
+        std::string sha256;
+        bool stored = false;
+        
+        if (op == "base") {
+            struct stat st;
+            if (stat(basePath.c_str(), &st) != 0 || (uint64_t)st.st_size != size) {
+                throw std::runtime_error(path + " in the base version is missing or has the wrong size");
+            }
+            auto known = baseFiles.find(path);
+            if (known == baseFiles.end() || known->second.size != size || known->second.crc != crc) {
+                uint32_t baseCrc = 0;
+                if (!fileCrc32(basePath, baseCrc, buf) || baseCrc != crc) {
+                    throw std::runtime_error(path + " in the base version does not match the runtime delta");
+                }
+            }
+            if (store && mode == 0644) {
+                // Share the base version's object when it has one, rather than copying
+                if (!fileSha256(basePath, sha256, buf)) {
+                    throw std::runtime_error("Failed to read " + path + " in the base version");
+                }
+                stored = store->materialize(sha256, dirs, path);
+            }
+            if (!stored && !reuseBaseFile(basePath, dirs, path, mode, buf)) {
+                throw std::runtime_error("Failed to copy " + path + " from the base version");
+            }
+        } else if (op == "data" || op == "patch") {
+            writeDeltaFile(reader, dirs, path, basePath, op == "patch", size, crc, mode, buf);
+        } else {
+            throw std::runtime_error("Unknown operation \"" + op + "\" for " + path + " in runtime delta");
+        }
+        index.record(path, size, crc);
+        
+        if (store) {
+            // Only plain 0644 files become shared objects, as when extracting
+            if ((sha256.empty() && !fileSha256(stagingDir + "/" + path, sha256, buf)) ||
+                (mode == 0644 && !stored && !store->adopt(dirs, path, sha256))) {
+                throw std::runtime_error("Failed to add " + path + " to the object store");
+            }
+            store->record({path, size, crc, mode, sha256});
+        }
+    }
+}
+
+// Compare dotted version numbers component by component
+static bool versionLess(const std::string& a, const std::string& b) {
+    std::vector<std::string> left = split(a, '.');
+    std::vector<std::string> right = split(b, '.');
+    for (size_t i = 0; i < std::max(left.size(), right.size()); i++) {
+        long x = i < left.size() ? std::atol(left[i].c_str()) : 0;
+        long y = i < right.size() ? std::atol(right[i].c_str()) : 0;
+        if (x != y) return x < y;
+    }
+    return false;
+}
+
+// Installed version to build a delta on: the newest one older than version
+static std::string deltaBaseVersion(const std::string& runtimeDir, const std::string& version) {
+    DIR* dir = opendir(runtimeDir.c_str());
+    if (!dir) return "";
+    
+    std::string older;
+    struct dirent* entry;
+    while ((entry = readdir(dir)) != nullptr) {
+        std::string name = entry->d_name;
+        if (name == version || name.empty() || !isdigit((unsigned char)name[0]) ||
+            name.find_first_not_of("0123456789.") != std::string::npos ||
+            !versionLess(name, version) || !fileExists(runtimeDir + "/" + name + "/openfin")) {
+            continue;
+        }
+        if (older.empty() || versionLess(older, name)) {
+            older = name;
+        }
+    }
+    closedir(dir);
+    return older;
+}
+
+// Build version in stagingDir from an installed version and the delta package at
+// <downloadURL>.from-<installed version>.delta. Returns false, with nothing left in
+// stagingDir, when there is no usable delta and the full archive has to be downloaded.
+static bool installFromDelta(const std::string& downloadURL, const std::string& runtimeDir,
+                             const std::string& stagingDir, const std::string& version,
+                             const InstallOptions& options) {
+    if (!options.deltaUpdates) return false;
+    // Only the full archive can be checked against a published digest
+    if (!options.expectedSha256.empty() || options.publishedDigest) return false;
+    std::string base = deltaBaseVersion(runtimeDir, version);
+    if (base.empty()) return false;
+    
+    std::string deltaURL = downloadURL + ".from-" + base + ".delta";
+    std::string deltaPath = stagingDir + ".delta";
+    auto installStart = std::chrono::steady_clock::now();
+    logWithTimestamp("Downloading runtime delta from: " + deltaURL);
+    
+    try {
+        downloadArchive(deltaURL, deltaPath, options.downloadConnections, options.limits);
+        createDirectory(stagingDir);
+        std::unique_ptr<ObjectStore> store;
+        if (!options.objectStoreDir.empty()) {
+            store.reset(new ObjectStore(options.objectStoreDir));
+        }
+        InstallIndex index;
+        applyRuntimeDelta(deltaPath, runtimeDir + "/" + base, base, stagingDir, version, index, store.get());
+        index.write(stagingDir);
+        if (store) {
+            store->writeIndex(version);
+        }
+    } catch (const DownloadYielded&) {
+        // The partial delta is kept so the download resumes next time
+        removeDirectory(stagingDir);
+        throw;
+    } catch (const HttpError& e) {
+        logWithTimestamp("No runtime delta from " + base + " (" + e.what() + "), downloading the full archive");
+        removeDirectory(stagingDir);
+        unlink(deltaPath.c_str());
+        return false;
+    } catch (const std::exception& e) {
+        countMetric("runtime_delta_failures");
+        logWithTimestamp(LOG_WARN, "Runtime delta from " + base + " failed (" + e.what() +
+                         "), downloading the full archive");
+        removeDirectory(stagingDir);
+        unlink(deltaPath.c_str());
+        unlink((deltaPath + ".state").c_str());
+        return false;
+    }
+    
+    struct stat st;
+    st.st_size = 0;
+    stat(deltaPath.c_str(), &st);
+    unlink(deltaPath.c_str());
+    countMetric("runtime_installs");
+    countMetric("runtime_delta_installs");
+    countMetric("runtime_download_bytes", st.st_size);
+    recordMetric("runtime_install_us", elapsedMicros(installStart));
+    logWithTimestamp("Built runtime " + version + " from " + base + " with a " + std::to_string(st.st_size) +
+                     " byte delta");
+    return true;
+}
+
+// Install into <runtime-dir>/.staging/<version> and rename it into place, holding
+// <runtime-dir>/.locks/<version>.lock so only one rvm-cpp process installs a version.
+// A process that finds the lock taken waits and then reuses what the holder installed.
+static void installRuntimeExclusive(const std::string& downloadURL, const std::string& targetDir,
+                                    const InstallOptions& options) {
+    size_t slash = targetDir.find_last_of('/');
+    std::string runtimeDir = slash == std::string::npos ? "." : targetDir.substr(0, slash);
+    std::string version = targetDir.substr(slash + 1);
+    if (!isValidRuntimeVersion(version)) {
+        throw std::runtime_error("Invalid runtime version: " + version);
+    }
+    
+    createDirectory(runtimeDir + "/.locks");
+    std::string lockPath = runtimeDir + "/.locks/" + version + ".lock";
+    int lockFd = open(lockPath.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+    if (lockFd < 0) {
+        throw std::runtime_error("Failed to open install lock " + lockPath + ": " + strerror(errno));
+    }
+    
+    // The kernel drops the lock if we die, so an abandoned install never blocks others
+    bool waited = false;
+    if (flock(lockFd, LOCK_EX | LOCK_NB) < 0) {
+        logWithTimestamp("Waiting for another rvm-cpp to finish installing runtime " + version);
+        waited = true;
+        while (flock(lockFd, LOCK_EX) < 0) {
+            if (errno != EINTR) {
+                close(lockFd);
+                throw std::runtime_error("Failed to lock " + lockPath + ": " + strerror(errno));
+            }
+        }
+    }
+    
+    try {
+        // Version directories only ever appear by rename, so one that is there now is a
+        // complete install, possibly finished by another process since the caller looked.
+        // It is only replaced when it fails the configured check.
+        if (fileExists(targetDir + "/openfin")) {
+            std::string problem;
+            if (options.verify == VERIFY_OFF ||
+                verifyInstalledRuntime(targetDir, options.verify == VERIFY_FULL, problem)) {
+                logWithTimestamp("Runtime " + version + " is already installed" +
+                                 (waited ? " by another rvm-cpp process" : ""));
+                close(lockFd);
+                return;
+            }
+            logWithTimestamp("Replacing runtime " + version + " (" + problem + ")");
+        }
+        
+        std::string stagingDir = runtimeDir + "/.staging/" + version;
+        removeDirectory(stagingDir);
+        createDirectory(runtimeDir + "/.staging");
+        
+        try {
+            if (!installFromDelta(downloadURL, runtimeDir, stagingDir, version, options)) {
+                installRuntime(downloadURL, stagingDir, version, options);
+            }
+        } catch (...) {
+            removeDirectory(stagingDir);
+            throw;
+        }
+        
+        // Set aside whatever a pre-staging or interrupted install left behind
+        std::string previousDir = stagingDir + ".old";
+        removeDirectory(previousDir);
+        if (fileExists(targetDir) && rename(targetDir.c_str(), previousDir.c_str()) < 0) {
+            throw std::runtime_error("Failed to move aside " + targetDir + ": " + strerror(errno));
+        }
+        if (rename(stagingDir.c_str(), targetDir.c_str()) < 0) {
+            int err = errno;
+            removeDirectory(stagingDir);
+            throw std::runtime_error("Failed to move runtime into " + targetDir + ": " + strerror(err));
+        }
+        removeDirectory(previousDir);
+    } catch (...) {
+        close(lockFd);
+        throw;
+    }
+    close(lockFd);
+    logWithTimestamp("Successfully extracted runtime to: " + targetDir);
+}
+
+// Download and extract runtime. Concurrent calls for the same target directory share
+// one install: the first does the work and the others wait for its outcome.
+void downloadAndExtractRuntime(const std::string& downloadURL, const std::string& targetDir,
+                               const InstallOptions& options) {
+    static std::mutex inFlightMutex;
+    static std::map<std::string, std::shared_future<void>> inFlight;
+    
+    while (true) {
+        std::promise<void> outcome;
+        std::shared_future<void> install;
+        bool owner = false;
+        {
+            std::lock_guard<std::mutex> lock(inFlightMutex);
+            auto it = inFlight.find(targetDir);
+            if (it != inFlight.end()) {
+                install = it->second;
+            } else {
+                install = outcome.get_future().share();
+                inFlight[targetDir] = install;
+                owner = true;
+            }
+        }
+        
+        if (!owner) {
+            logWithTimestamp("Waiting for the install of " + targetDir + " already in progress");
+            try {
+                install.get();
+                return;
+            } catch (const DownloadYielded&) {
+                // A background install gave way to launches, which includes ours
+                continue;
+            }
+        }
+        
+        try {
+            installRuntimeExclusive(downloadURL, targetDir, options);
+            outcome.set_value();
+        } catch (...) {
+            outcome.set_exception(std::current_exception());
+        }
+        {
+            std::lock_guard<std::mutex> lock(inFlightMutex);
+            inFlight.erase(targetDir);
+        }
+        install.get();
+        return;
+    }
+}
+
+// ProcessSupervisor
+ProcessSupervisor& ProcessSupervisor::instance() {
+    static ProcessSupervisor* supervisor = new ProcessSupervisor();
+    return *supervisor;
+}
+
+void ProcessSupervisor::start() {
+    std::call_once(started, [this]() {
+        sigset_t mask;
+        sigemptyset(&mask);
+        sigaddset(&mask, SIGCHLD);
+        // Inherited by every thread created from here on
+        pthread_sigmask(SIG_BLOCK, &mask, NULL);
+        signalFd = signalfd(-1, &mask, SFD_CLOEXEC);
+        if (signalFd < 0) {
+            logWithTimestamp(LOG_ERROR, std::string("Failed to create signalfd, children will not be reaped: ") +
+                             strerror(errno));
+            return;
+        }
+        std::thread(&ProcessSupervisor::run, this).detach();
+    });
+}
+
+pid_t ProcessSupervisor::launch(const std::string& path, const std::vector<std::string>& args,
+                                const std::string& manifestUrl, const std::string& runtimeVersion) {
+    start();
+    
+    std::vector<char*> argv;
+    argv.push_back(const_cast<char*>(path.c_str()));
+    for (const auto& arg : args) {
+        argv.push_back(const_cast<char*>(arg.c_str()));
+    }
+    argv.push_back(nullptr);
+    
+    // The runtime starts with an empty signal mask and default SIGCHLD/SIGPIPE handling
+    posix_spawnattr_t attr;
+    posix_spawnattr_init(&attr);
+    sigset_t empty, defaults;
+    sigemptyset(&empty);
+    sigemptyset(&defaults);
+    sigaddset(&defaults, SIGCHLD);
+    sigaddset(&defaults, SIGPIPE);
+    posix_spawnattr_setsigmask(&attr, &empty);
+    posix_spawnattr_setsigdefault(&attr, &defaults);
+    posix_spawnattr_setflags(&attr, POSIX_SPAWN_SETSIGMASK | POSIX_SPAWN_SETSIGDEF);
+    
+    pid_t pid = -1;
+    auto before = std::chrono::steady_clock::now();
+    {
+        // Held across the spawn so the reaper cannot see the pid before it is recorded
+        std::lock_guard<std::mutex> lock(mutex);
+        int err = posix_spawn(&pid, path.c_str(), NULL, &attr, argv.data(), environ);
+        posix_spawnattr_destroy(&attr);
+        if (err != 0) {
+            countMetric("launch_failures");
+            logWithTimestamp(LOG_ERROR, "Failed to spawn " + path + ": " + strerror(err));
+            return -1;
+        }
+        
+        ChildProcess child;
+        child.pid = pid;
+        child.manifestUrl = manifestUrl;
+        child.runtimeVersion = runtimeVersion;
+        child.launchMicros = elapsedMicros(before);
+        child.started = std::chrono::steady_clock::now();
+        running[pid] = child;
+        recordMetric("launch_to_exec_us", child.launchMicros);
+    }
+    countMetric("launches");
+    return pid;
+}
+
+void ProcessSupervisor::run() {
+    while (true) {
+        struct signalfd_siginfo info;
+        ssize_t n = read(signalFd, &info, sizeof(info));
+        if (n < 0 && errno == EINTR) continue;
+        if (n != sizeof(info)) {
+            logWithTimestamp(LOG_ERROR, std::string("Process supervisor failed: ") + strerror(errno));
+            return;
+        }
+        reap();
+    }
+}
+
+// SIGCHLDs coalesce, so check every child we launched. Only our own pids are waited
+// for, leaving other children (e.g. of system()) to whoever started them.
+void ProcessSupervisor::reap() {
+    std::lock_guard<std::mutex> lock(mutex);
+    for (auto it = running.begin(); it != running.end();) {
+        int status = 0;
+        pid_t pid = waitpid(it->first, &status, WNOHANG);
+        if (pid == 0 || (pid < 0 && errno == EINTR)) {
+            ++it;
+            continue;
+        }
+        
+        ChildProcess child = it->second;
+        it = running.erase(it);
+        child.running = false;
+        child.status = status;
+        recordMetric("app_lifetime_us", elapsedMicros(child.started));
+        countMetric("app_exits");
+        
+        if (WIFSIGNALED(status)) {
+            countMetric("app_crashes");
+            logWithTimestamp(LOG_WARN, "Application " + std::to_string(child.pid) + " (" + child.manifestUrl +
+                             ") killed by signal " + std::to_string(WTERMSIG(status)));
+        } else {
+            logWithTimestamp("Application " + std::to_string(child.pid) + " (" + child.manifestUrl +
+                             ") exited with status " + std::to_string(WEXITSTATUS(status)));
+        }
+        
+        exited.push_back(child);
+        if (exited.size() > SUPERVISOR_EXITED_HISTORY) {
+            exited.pop_front();
+        }
+    }
+}
+
+json ProcessSupervisor::snapshot() {
+    auto describe = [](const ChildProcess& child) {
+        json entry = {
+            {"pid", child.pid},
+            {"manifestUrl", child.manifestUrl},
+            {"runtimeVersion", child.runtimeVersion},
+            {"launch_to_exec_us", child.launchMicros},
+            {"running", child.running}
+        };
+        if (!child.running) {
+            if (WIFSIGNALED(child.status)) {
+                entry["signal"] = WTERMSIG(child.status);
+            } else {
+                entry["exitStatus"] = WEXITSTATUS(child.status);
+            }
+        }
+        return entry;
+    };
+    
+    json result = json::array();
+    std::lock_guard<std::mutex> lock(mutex);
+    for (const auto& entry : running) {
+        result.push_back(describe(entry.second));
+    }
+    for (const auto& child : exited) {
+        result.push_back(describe(child));
+    }
+    return result;
+}
+
+std::string ProcessSupervisor::manifestUrlOf(pid_t pid) {
+    // Runtime helpers may connect on the application's behalf: walk up their parents
+    for (int depth = 0; pid > 1 && depth < 8; depth++) {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            auto it = running.find(pid);
+            if (it != running.end()) return it->second.manifestUrl;
+        }
+        std::ifstream stat("/proc/" + std::to_string(pid) + "/stat");
+        std::string line;
+        if (!std::getline(stat, line)) break;
+        // pid (comm) state ppid ...; comm may itself contain spaces and parentheses
+        size_t close = line.rfind(')');
+        if (close == std::string::npos) break;
+        std::istringstream fields(line.substr(close + 1));
+        std::string state;
+        fields >> state >> pid;
+        if (!fields) break;
+    }
+    return "";
+}
+
+// Launch application
+void launchApplication(const std::string& appPath, const std::string& manifestUrl,
+                       const std::string& runtimeArgs, const std::string& runtimeVersion) {
+    logWithTimestamp("Launching application: " + appPath + " with manifest URL: " + manifestUrl);
+    
+    if (access(appPath.c_str(), F_OK) != 0) {
+        logWithTimestamp("Application not found at path: " + appPath);
+        return;
+    }
+    
+    std::vector<std::string> args;
+    args.push_back("--config=" + manifestUrl);
+    if (!runtimeArgs.empty()) {
+        args.push_back(runtimeArgs);
+    }
+    args.push_back("--v=1");
+    args.push_back("--version-keyword=" + runtimeVersion);
+    args.push_back("--message-timeout=5000");
+    args.push_back("--desktop-owner-settings-timeout=5000");
+    
+    pid_t pid = ProcessSupervisor::instance().launch(appPath, args, manifestUrl, runtimeVersion);
+    if (pid > 0) {
+        logWithTimestamp("Application started with PID: " + std::to_string(pid));
+    }
+}
+
+// LaunchPipeline
+LaunchPipeline::LaunchPipeline(const std::vector<std::string>& urls, const PipelineOptions& options)
+    : urls(urls), options(options) {
+}
 
-// Log with timestamp
-void logWithTimestamp(const std::string& message) {
-    auto now = std::time(nullptr);
-    auto tm = *std::localtime(&now);
-    std::cerr << "[" << std::put_time(&tm, "%Y-%m-%d %H:%M:%S") << "] " << message << std::endl;
+// DownloadSlots
+DownloadSlots& DownloadSlots::instance() {
+    static DownloadSlots* slots = new DownloadSlots();
+    return *slots;
 }
 
-// Get CPU architecture
-std::string getCPUArch() {
-#if defined(__x86_64__) || defined(_M_X64)
-    return "x64";
-#elif defined(__aarch64__) || defined(_M_ARM64)
-    return "arm64";
-#else
-    return "x64"; // default
-#endif
+void DownloadSlots::acquire(int limit) {
+    std::unique_lock<std::mutex> lock(mutex);
+    freed.wait(lock, [this, limit] { return active < std::max(1, limit); });
+    active++;
 }
 
-// Callback for CURL to write data to string
-size_t writeCallback(void* contents, size_t size, size_t nmemb, std::string* output) {
-    size_t totalSize = size * nmemb;
-    output->append((char*)contents, totalSize);
-    return totalSize;
+void DownloadSlots::release() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        active--;
+    }
+    freed.notify_all();
 }
 
-// Callback for CURL to write data to file
-size_t writeFileCallback(void* ptr, size_t size, size_t nmemb, FILE* stream) {
-    return fwrite(ptr, size, nmemb, stream);
+std::atomic<int> LaunchPipeline::activePipelines{0};
+std::atomic<int64_t> LaunchPipeline::lastLaunch{0};
+
+bool LaunchPipeline::launching() {
+    if (activePipelines > 0) return true;
+    int64_t last = lastLaunch;
+    int64_t now = std::chrono::steady_clock::now().time_since_epoch().count();
+    auto quiet = std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+        std::chrono::milliseconds(LAUNCH_QUIET_PERIOD_MS)).count();
+    return last != 0 && now - last < quiet;
 }
 
-// Fetch config from URL
-Config fetchConfig(const std::string& url) {
-    CURL* curl = curl_easy_init();
-    Config config;
-    
-    if (!curl) {
-        throw std::runtime_error("Failed to initialize CURL");
+void LaunchPipeline::start() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        remaining = urls.size();
     }
+    if (urls.empty()) return;
+    activePipelines++;
+    started = std::chrono::steady_clock::now();
     
-    std::string response;
-    curl_easy_setopt(curl, CURLOPT_URL, url.c_str());
-    curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, writeCallback);
-    curl_easy_setopt(curl, CURLOPT_WRITEDATA, &response);
-    curl_easy_setopt(curl, CURLOPT_FOLLOWLOCATION, 1L);
-    
-    CURLcode res = curl_easy_perform(curl);
+    auto self = shared_from_this();
+    std::thread([self]() {
+        logWithTimestamp("Fetching " + std::to_string(self->urls.size()) + " config(s)...");
+        fetchConfigs(self->urls, self->options.fetch, [&self](const FetchResult& fetched) {
+            self->manifestReady(fetched);
+        });
+    }).detach();
+}
+
+void LaunchPipeline::wait() {
+    std::unique_lock<std::mutex> lock(mutex);
+    changed.wait(lock, [this] { return remaining == 0; });
+}
+
+// Runs on the fetch thread as each manifest arrives; anything slow goes to its own thread
+void LaunchPipeline::manifestReady(const FetchResult& fetched) {
+    const std::string& url = fetched.url;
+    if (!fetched.ok) {
+        logWithTimestamp(LOG_ERROR, "Error fetching config from " + url + ": " + fetched.error);
+        finish(1);
+        return;
+    }
     
-    if (res != CURLE_OK) {
-        curl_easy_cleanup(curl);
-        throw std::runtime_error(std::string("CURL error: ") + curl_easy_strerror(res));
+    const Config& config = fetched.config;
+    if (config.version.empty()) {
+        logWithTimestamp(LOG_ERROR, "Error: runtime.version not found in config from " + url);
+        finish(1);
+        return;
     }
     
-    long httpCode = 0;
-    curl_easy_getinfo(curl, CURLINFO_RESPONSE_CODE, &httpCode);
-    curl_easy_cleanup(curl);
+    logWithTimestamp("Runtime version: " + config.version + " for config: " + url +
+                     (fetched.fromCache ? " (cached)" : ""));
     
-    if (httpCode != 200) {
-        throw std::runtime_error("HTTP error: " + std::to_string(httpCode));
-    }
+    std::string runtimePath = options.runtimeDir + "/" + config.version + "/openfin";
+    LaunchInfo info = {runtimePath, url, config.arguments, config.version};
     
-    // Parse JSON
-    auto jsonObj = json::parse(response);
-    config.version = jsonObj["runtime"]["version"].get<std::string>();
-    config.arguments = jsonObj["runtime"].value("arguments", "");
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        auto pending = installing.find(config.version);
+        if (pending != installing.end()) {
+            pending->second.push_back(info);
+            return;
+        }
+        // Checking an install may read every file, so it happens on the install thread
+        bool unchecked = options.install.verify != VERIFY_OFF && !verified[config.version];
+        if (!fileExists(runtimePath) || unchecked) {
+            installing[config.version].push_back(info);
+            std::thread(&LaunchPipeline::install, shared_from_this(), config.version, config.sha256).detach();
+            return;
+        }
+    }
     
-    return config;
+    logWithTimestamp("Runtime ready at path: " + runtimePath);
+    launch(info);
+    finish(1);
 }
 
-// Extract zip file
-void extractZip(const std::string& zipPath, const std::string& destDir) {
-    int err = 0;
-    zip* za = zip_open(zipPath.c_str(), 0, &err);
+// Check or install one runtime version, then launch everything that was waiting on it
+void LaunchPipeline::install(const std::string& version, const std::string& sha256) {
+    std::string runtimePath = options.runtimeDir + "/" + version + "/openfin";
+    std::string targetDir = options.runtimeDir + "/" + version;
     
-    if (!za) {
-        throw std::runtime_error("Failed to open zip file");
+    bool ready = false;
+    if (fileExists(runtimePath)) {
+        auto verifyStart = std::chrono::steady_clock::now();
+        std::string problem;
+        ready = verifyInstalledRuntime(targetDir, options.install.verify == VERIFY_FULL, problem);
+        recordMetric("runtime_verify_us", elapsedMicros(verifyStart));
+        if (!ready) {
+            countMetric("runtime_verify_failures");
+            logWithTimestamp(LOG_WARN, "Runtime " + version + " failed its integrity check (" + problem +
+                             "), reinstalling");
+        }
+    } else {
+        logWithTimestamp("Runtime not found at path: " + runtimePath);
     }
     
-    zip_int64_t numEntries = zip_get_num_entries(za, 0);
-    
-    for (zip_int64_t i = 0; i < numEntries; i++) {
-        struct zip_stat st;
-        zip_stat_init(&st);
-        zip_stat_index(za, i, 0, &st);
-        
-        std::string filePath = destDir + "/" + st.name;
-        
-        // Check if it's a directory
-        if (st.name[strlen(st.name) - 1] == '/') {
-            mkdir(filePath.c_str(), 0755);
-            continue;
-        }
-        
-        // Create parent directories
-        size_t pos = filePath.find_last_of('/');
-        if (pos != std::string::npos) {
-            std::string dir = filePath.substr(0, pos);
-            std::string cmd = "mkdir -p " + dir;
-            system(cmd.c_str());
-        }
+    if (!ready) {
+        DownloadSlots::instance().acquire(options.maxDownloads);
         
-        // Extract file
-        zip_file* zf = zip_fopen_index(za, i, 0);
-        if (!zf) continue;
+        std::string cpuArch = getCPUArch();
+        logWithTimestamp("Detected CPU architecture: " + cpuArch);
         
-        FILE* outFile = fopen(filePath.c_str(), "wb");
-        if (!outFile) {
-            zip_fclose(zf);
-            continue;
-        }
+        std::string downloadURL = options.runtimeBaseURL + "/" + cpuArch + "/" + version;
+        InstallOptions install = options.install;
+        install.expectedSha256 = sha256;
         
-        char buf[8192];
-        zip_int64_t bytesRead;
-        while ((bytesRead = zip_fread(zf, buf, sizeof(buf))) > 0) {
-            fwrite(buf, 1, bytesRead, outFile);
+        try {
+            downloadAndExtractRuntime(downloadURL, targetDir, install);
+            ready = fileExists(runtimePath);
+            if (!ready) {
+                logWithTimestamp("Runtime still not found after extraction at path: " + runtimePath);
+            }
+        } catch (const std::exception& e) {
+            logWithTimestamp(LOG_ERROR, "Failed to download and extract runtime: " + std::string(e.what()));
         }
-        
-        fclose(outFile);
-        zip_fclose(zf);
-        
-        // Set default permissions (readable/writable by user, readable by group/others)
-        chmod(filePath.c_str(), 0644);
+        DownloadSlots::instance().release();
     }
     
-    zip_close(za);
+    std::vector<LaunchInfo> waiting;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        verified[version] = ready;
+        waiting.swap(installing[version]);
+        installing.erase(version);
+    }
+    changed.notify_all();
+    
+    if (ready) {
+        logWithTimestamp("Runtime ready at path: " + runtimePath);
+        for (const auto& info : waiting) {
+            launch(info);
+        }
+    }
+    finish(waiting.size());
 }
 
-// Download and extract runtime
-void downloadAndExtractRuntime(const std::string& downloadURL, const std::string& targetDir) {
-    logWithTimestamp("Downloading runtime from: " + downloadURL);
-    
-    std::string tmpFile = "/tmp/openfin-runtime-" + std::to_string(time(nullptr)) + ".zip";
+void LaunchPipeline::launch(const LaunchInfo& info) {
+    if (!options.launch) return;
     
-    CURL* curl = curl_easy_init();
-    if (!curl) {
-        throw std::runtime_error("Failed to initialize CURL");
+    launchApplication(info.runtimePath, info.configURL, info.runtimeArgs, info.runtimeVersion);
+    lastLaunch = std::chrono::steady_clock::now().time_since_epoch().count();
+    recordMetric("manifest_to_launch_us", elapsedMicros(started));
+    std::lock_guard<std::mutex> lock(mutex);
+    launched++;
+}
+
+// Mark manifests as done; the last one reports how the whole run went
+void LaunchPipeline::finish(size_t manifests) {
+    size_t launchedCount;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        remaining -= std::min(remaining, manifests);
+        if (remaining > 0) return;
+        launchedCount = launched;
     }
+    activePipelines--;
     
-    FILE* fp = fopen(tmpFile.c_str(), "wb");
-    if (!fp) {
-        curl_easy_cleanup(curl);
-        throw std::runtime_error("Failed to create temporary file");
+    HttpStats httpStats = HttpClient::instance().stats();
+    logWithTimestamp("HTTP: " + std::to_string(httpStats.requests) + " request(s) over " +
+                     std::to_string(httpStats.connections) + " new connection(s), " +
+                     std::to_string(httpStats.requests - httpStats.connections) + " reused");
+    logWithTimestamp("All manifests processed in " + std::to_string(elapsedMicros(started) / 1000) +
+                     " ms, " + std::to_string(launchedCount) + " application(s) launched");
+    changed.notify_all();
+}
+
+// RuntimePrefetcher
+RuntimePrefetcher& RuntimePrefetcher::instance() {
+    static RuntimePrefetcher* prefetcher = new RuntimePrefetcher();
+    return *prefetcher;
+}
+
+void RuntimePrefetcher::start(const PrefetchOptions& options, const PipelineOptions& pipeline) {
+    if (options.intervalSeconds <= 0 || options.urls.empty()) return;
+    std::call_once(started, [&]() {
+        this->options = options;
+        this->pipeline = pipeline;
+        std::thread(&RuntimePrefetcher::run, this).detach();
+    });
+}
+
+void RuntimePrefetcher::run() {
+    // Idle I/O class and a lower CPU priority for this thread and the extraction
+    // workers it creates, which inherit both
+    const int IOPRIO_WHO_PROCESS = 1;
+    const int IOPRIO_CLASS_IDLE = 3;
+    const int IOPRIO_CLASS_SHIFT = 13;
+    if (syscall(SYS_ioprio_set, IOPRIO_WHO_PROCESS, 0, IOPRIO_CLASS_IDLE << IOPRIO_CLASS_SHIFT) < 0) {
+        logWithTimestamp(LOG_WARN, std::string("Prefetch runs at normal I/O priority: ") + strerror(errno));
     }
+    setpriority(PRIO_PROCESS, (id_t)syscall(SYS_gettid), 10);
     
-    curl_easy_setopt(curl, CURLOPT_URL, downloadURL.c_str());
-    curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, writeFileCallback);
-    curl_easy_setopt(curl, CURLOPT_WRITEDATA, fp);
-    curl_easy_setopt(curl, CURLOPT_FOLLOWLOCATION, 1L);
-    
-    CURLcode res = curl_easy_perform(curl);
-    fclose(fp);
-    
-    if (res != CURLE_OK) {
-        curl_easy_cleanup(curl);
-        unlink(tmpFile.c_str());
-        throw std::runtime_error(std::string("Download failed: ") + curl_easy_strerror(res));
+    logWithTimestamp("Prefetching runtimes for " + std::to_string(options.urls.size()) +
+                     " config(s) every " + std::to_string(options.intervalSeconds) + " s");
+    while (true) {
+        try {
+            checkOnce();
+        } catch (const std::exception& e) {
+            logWithTimestamp(LOG_ERROR, std::string("Error during runtime prefetch: ") + e.what());
+        }
+        std::this_thread::sleep_for(std::chrono::seconds(options.intervalSeconds));
     }
+}
+
+void RuntimePrefetcher::checkOnce() {
+    FetchOptions fetch = pipeline.fetch;
+    fetch.staleWhileRevalidate = false;
     
-    long httpCode = 0;
-    curl_easy_getinfo(curl, CURLINFO_RESPONSE_CODE, &httpCode);
-    curl_easy_cleanup(curl);
-    
-    if (httpCode != 200) {
-        unlink(tmpFile.c_str());
-        throw std::runtime_error("HTTP error: " + std::to_string(httpCode));
+    // Version -> archive digest named by its manifest
+    std::map<std::string, std::string> missing;
+    for (const auto& fetched : fetchConfigs(options.urls, fetch)) {
+        if (!fetched.ok) {
+            logWithTimestamp(LOG_WARN, "Prefetch could not fetch config from " + fetched.url + ": " + fetched.error);
+            continue;
+        }
+        if (fetched.config.version.empty()) continue;
+        const std::string& version = fetched.config.version;
+        if (fileExists(pipeline.runtimeDir + "/" + version + "/openfin")) continue;
+        if (missing[version].empty()) {
+            missing[version] = fetched.config.sha256;
+        }
     }
     
-    logWithTimestamp("Downloaded runtime to: " + tmpFile);
-    
-    // Create target directory
-    std::string cmd = "mkdir -p " + targetDir;
-    system(cmd.c_str());
-    
-    // Extract
-    logWithTimestamp("Extracting runtime to: " + targetDir);
-    extractZip(tmpFile, targetDir);
-    
-    unlink(tmpFile.c_str());
-    logWithTimestamp("Successfully extracted runtime to: " + targetDir);
+    for (const auto& entry : missing) {
+        install(entry.first, entry.second);
+    }
 }
 
-// Launch application
-void launchApplication(const std::string& appPath, const std::string& manifestUrl,
-                       const std::string& runtimeArgs, const std::string& runtimeVersion) {
-    logWithTimestamp("Launching application: " + appPath + " with manifest URL: " + manifestUrl);
-    
-    if (access(appPath.c_str(), F_OK) != 0) {
-        logWithTimestamp("Application not found at path: " + appPath);
-        return;
-    }
+void RuntimePrefetcher::install(const std::string& version, const std::string& sha256) {
+    InstallOptions install = pipeline.install;
+    install.expectedSha256 = sha256;
+    // Ranged downloads keep their progress when they stop for a launch
+    install.streaming = false;
+    install.limits.maxBytesPerSec = options.maxBytesPerSec;
+    install.limits.yieldToLaunches = true;
     
-    pid_t pid = fork();
+    std::string downloadURL = pipeline.runtimeBaseURL + "/" + getCPUArch() + "/" + version;
+    std::string targetDir = pipeline.runtimeDir + "/" + version;
     
-    if (pid == 0) {
-        // Child process
-        std::vector<const char*> args;
-        args.push_back(appPath.c_str());
-        
-        std::string configArg = "--config=" + manifestUrl;
-        args.push_back(configArg.c_str());
-        
-        if (!runtimeArgs.empty()) {
-            args.push_back(runtimeArgs.c_str());
+    while (true) {
+        while (LaunchPipeline::launching()) {
+            std::this_thread::sleep_for(std::chrono::seconds(1));
         }
         
-        args.push_back("--v=1");
-        
-        std::string versionArg = "--version-keyword=" + runtimeVersion;
-        args.push_back(versionArg.c_str());
-        
-        args.push_back("--message-timeout=5000");
-        args.push_back("--desktop-owner-settings-timeout=5000");
-        args.push_back(nullptr);
-        
-        execv(appPath.c_str(), const_cast<char* const*>(args.data()));
-        
-        // If execv returns, it failed
-        std::cerr << "Failed to execute application" << std::endl;
-        exit(1);
-    } else if (pid > 0) {
-        logWithTimestamp("Application started with PID: " + std::to_string(pid));
-    } else {
-        logWithTimestamp("Failed to fork process");
+        logWithTimestamp("Prefetching runtime " + version);
+        DownloadSlots::instance().acquire(pipeline.maxDownloads);
+        try {
+            downloadAndExtractRuntime(downloadURL, targetDir, install);
+            DownloadSlots::instance().release();
+            countMetric("prefetch_installs");
+            return;
+        } catch (const DownloadYielded&) {
+            DownloadSlots::instance().release();
+            countMetric("prefetch_yields");
+            logWithTimestamp("Prefetch of runtime " + version + " paused while applications launch");
+        } catch (const std::exception& e) {
+            DownloadSlots::instance().release();
+            countMetric("prefetch_failures");
+            logWithTimestamp(LOG_ERROR, "Failed to prefetch runtime " + version + ": " + e.what());
+            return;
+        }
     }
 }
 
-// Send to runtime socket
-void sendToRuntime(const std::string& runtimeSocketName, const json& payload, const std::string& socketPath) {
-    int sockfd = socket(AF_UNIX, SOCK_STREAM, 0);
-    if (sockfd < 0) {
-        logWithTimestamp("Failed to create socket");
-        return;
+// Register or update fd's events on the epoll set
+static void watchFd(int epollFd, int fd, uint32_t events) {
+    struct epoll_event ev;
+    memset(&ev, 0, sizeof(ev));
+    ev.events = events;
+    ev.data.fd = fd;
+    if (epoll_ctl(epollFd, EPOLL_CTL_MOD, fd, &ev) < 0 && errno == ENOENT) {
+        epoll_ctl(epollFd, EPOLL_CTL_ADD, fd, &ev);
+    }
+}
+
+// RuntimeConnectionPool
+RuntimeConnectionPool& RuntimeConnectionPool::instance() {
+    static RuntimeConnectionPool* pool = new RuntimeConnectionPool();
+    return *pool;
+}
+
+// Inode of the socket file at path, 0 if it does not exist
+static ino_t socketInode(const std::string& path) {
+    struct stat st;
+    return stat(path.c_str(), &st) == 0 ? st.st_ino : 0;
+}
+
+// An idle connection is usable if the peer has neither closed it nor sent anything unasked
+static bool idleConnectionHealthy(int fd) {
+    struct pollfd pfd = {fd, POLLIN, 0};
+    return poll(&pfd, 1, 0) == 0;
+}
+
+RuntimeConnection RuntimeConnectionPool::acquire(const std::string& runtimeSocketName) {
+    auto now = std::chrono::steady_clock::now();
+    ino_t inode = socketInode(runtimeSocketName);
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (now - lastEviction >= std::chrono::seconds(10)) {
+            evictLocked(now);
+        }
+        
+        auto it = idle.find(runtimeSocketName);
+        while (it != idle.end() && !it->second.empty()) {
+            RuntimeConnection connection = it->second.back().connection;
+            it->second.pop_back();
+            if (connection.inode == inode && idleConnectionHealthy(connection.fd)) {
+                connection.reused = true;
+                return connection;
+            }
+            close(connection.fd);
+        }
+        if (it != idle.end()) {
+            idle.erase(it);
+        }
+    }
+    
+    // Non-blocking: a runtime with a full backlog fails the attempt instead of stalling it
+    RuntimeConnection connection;
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (fd < 0) {
+        logWithTimestamp(LOG_ERROR, "Failed to create socket");
+        return connection;
     }
     
     struct sockaddr_un addr;
@@ -294,60 +4463,291 @@ void sendToRuntime(const std::string& runtimeSocketName, const json& payload, co
     addr.sun_family = AF_UNIX;
     strncpy(addr.sun_path, runtimeSocketName.c_str(), sizeof(addr.sun_path) - 1);
     
-    if (connect(sockfd, (struct sockaddr*)&addr, sizeof(addr)) < 0) {
-        logWithTimestamp("Failed to connect to socket: " + runtimeSocketName);
-        close(sockfd);
-        return;
+    if (connect(fd, (struct sockaddr*)&addr, sizeof(addr)) < 0) {
+        logWithTimestamp(LOG_ERROR, "Failed to connect to socket: " + runtimeSocketName);
+        close(fd);
+        return connection;
     }
     
     logWithTimestamp("Connected to socket: " + runtimeSocketName);
+    connection.fd = fd;
+    connection.inode = socketInode(runtimeSocketName);
+    return connection;
+}
+
+void RuntimeConnectionPool::release(const std::string& runtimeSocketName, const RuntimeConnection& connection,
+                                    bool healthy) {
+    if (connection.fd < 0) return;
+    if (healthy) {
+        std::lock_guard<std::mutex> lock(mutex);
+        auto& list = idle[runtimeSocketName];
+        if (list.size() < RUNTIME_IDLE_CONNECTIONS) {
+            list.push_back({connection, std::chrono::steady_clock::now()});
+            return;
+        }
+    }
+    close(connection.fd);
+}
+
+void RuntimeConnectionPool::evictLocked(std::chrono::steady_clock::time_point now) {
+    lastEviction = now;
+    auto maxIdle = std::chrono::milliseconds(RUNTIME_CONNECTION_IDLE_MS);
+    for (auto it = idle.begin(); it != idle.end();) {
+        ino_t inode = socketInode(it->first);
+        auto& list = it->second;
+        for (size_t i = 0; i < list.size();) {
+            if (list[i].connection.inode != inode || now - list[i].since > maxIdle) {
+                close(list[i].connection.fd);
+                list.erase(list.begin() + i);
+            } else {
+                i++;
+            }
+        }
+        if (list.empty()) {
+            if (inode == 0) {
+                logWithTimestamp("Runtime socket gone, dropped its connections: " + it->first);
+            }
+            it = idle.erase(it);
+        } else {
+            ++it;
+        }
+    }
+}
+
+// ReplyDispatcher
+ReplyDispatcher& ReplyDispatcher::instance() {
+    static ReplyDispatcher* dispatcher = new ReplyDispatcher();
+    return *dispatcher;
+}
+
+void ReplyDispatcher::start(const ReplyOptions& replyOptions) {
+    std::call_once(started, [this, &replyOptions]() {
+        options = replyOptions;
+        epollFd = epoll_create1(EPOLL_CLOEXEC);
+        wakeFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+        if (epollFd < 0 || wakeFd < 0) {
+            throw std::runtime_error("Failed to set up reply dispatcher");
+        }
+        watchFd(epollFd, wakeFd, EPOLLIN);
+        std::thread(&ReplyDispatcher::run, this).detach();
+    });
+}
+
+void ReplyDispatcher::enqueue(const std::string& runtimeSocketName, std::string message,
+                              const ReplyOrigin& origin) {
+    start(ReplyOptions());
+    OutboundReply reply;
+    reply.message = std::move(message);
+    reply.origin = origin;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        incoming.emplace_back(runtimeSocketName, std::move(reply));
+    }
+    uint64_t one = 1;
+    ssize_t ignored = write(wakeFd, &one, sizeof(one));
+    (void)ignored;
+}
+
+void ReplyDispatcher::run() {
+    std::vector<struct epoll_event> events(64);
+    std::vector<std::pair<std::string, OutboundReply>> arrived;
     
-    // Marshal JSON
-    std::string jsonData = payload.dump();
-    
-    // Create message: socketPath:S:jsonData
-    std::string message = socketPath + ":S:" + jsonData;
-    
-    // Send message
-    ssize_t sent = send(sockfd, message.c_str(), message.length(), 0);
-    if (sent < 0) {
-        logWithTimestamp("Failed to send data to socket");
-        close(sockfd);
+    while (true) {
+        // Sleep until I/O, a new reply, or the nearest deadline or retry
+        auto now = std::chrono::steady_clock::now();
+        long timeoutMs = -1;
+        for (const auto& entry : channels) {
+            const Channel& channel = entry.second;
+            if (channel.queue.empty()) continue;
+            auto due = channel.inFlight ? channel.deadline : channel.retryAt;
+            long wait = std::max<long>(0, std::chrono::duration_cast<std::chrono::milliseconds>(due - now).count() + 1);
+            timeoutMs = (timeoutMs < 0) ? wait : std::min(timeoutMs, wait);
+        }
+        
+        int count = epoll_wait(epollFd, events.data(), (int)events.size(), (int)timeoutMs);
+        if (count < 0) {
+            if (errno == EINTR) continue;
+            logWithTimestamp(std::string("Reply dispatcher failed: ") + strerror(errno));
+            return;
+        }
+        
+        for (int i = 0; i < count; i++) {
+            int fd = events[i].data.fd;
+            if (fd == wakeFd) {
+                uint64_t value;
+                ssize_t ignored = read(wakeFd, &value, sizeof(value));
+                (void)ignored;
+                {
+                    std::lock_guard<std::mutex> lock(mutex);
+                    arrived.swap(incoming);
+                }
+                for (auto& reply : arrived) {
+                    Channel& channel = channels[reply.first];
+                    if (channel.queue.size() >= MAX_QUEUED_REPLIES_PER_RUNTIME) {
+                        // Keep the reply being written; drop the oldest one still waiting
+                        channel.queue.erase(channel.queue.begin() + (channel.inFlight ? 1 : 0));
+                        countMetric("replies_dropped");
+                        logWithTimestamp(LOG_WARN, "Reply queue for " + reply.first + " is full, dropped oldest reply");
+                    }
+                    channel.queue.push_back(std::move(reply.second));
+                }
+                arrived.clear();
+                continue;
+            }
+            
+            auto it = fdChannels.find(fd);
+            if (it == fdChannels.end()) continue;
+            std::string name = it->second;
+            Channel& channel = channels[name];
+            if (channel.sent < channel.queue.front().message.size()) {
+                writeReply(name, channel);
+            } else {
+                readAck(name, channel);
+            }
+        }
+        
+        now = std::chrono::steady_clock::now();
+        for (auto it = channels.begin(); it != channels.end();) {
+            Channel& channel = it->second;
+            if (channel.inFlight && now >= channel.deadline) {
+                failReply(it->first, channel, "no response within " + std::to_string(options.timeoutMs) + " ms", false);
+            }
+            if (!channel.inFlight && !channel.queue.empty() && now >= channel.retryAt) {
+                startNext(it->first, channel);
+            }
+            
+            if (!channel.inFlight && channel.queue.empty()) {
+                it = channels.erase(it);
+            } else {
+                ++it;
+            }
+        }
+    }
+}
+
+void ReplyDispatcher::startNext(const std::string& name, Channel& channel) {
+    channel.connection = RuntimeConnectionPool::instance().acquire(name);
+    if (channel.connection.fd < 0) {
+        failReply(name, channel, "cannot connect", true);
         return;
     }
+    if (channel.connection.reused) {
+        logWithTimestamp(LOG_DEBUG, "Reusing connection to socket: " + name);
+    }
     
-    logWithTimestamp("Sent JSON payload to socket (" + std::to_string(sent) + " bytes written)");
-    logWithTimestamp("Waiting for response from socket...");
-    
-    // Wait for response
-    char responseBuffer[1024];
-    ssize_t n = recv(sockfd, responseBuffer, sizeof(responseBuffer) - 1, 0);
+    channel.inFlight = true;
+    channel.sent = 0;
+    channel.ack.clear();
+    channel.deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(options.timeoutMs);
+    fdChannels[channel.connection.fd] = name;
+    writeReply(name, channel);
+}
+
+void ReplyDispatcher::writeReply(const std::string& name, Channel& channel) {
+    const std::string& message = channel.queue.front().message;
+    int fd = channel.connection.fd;
+    while (channel.sent < message.size()) {
+        ssize_t n = send(fd, message.data() + channel.sent, message.size() - channel.sent, MSG_NOSIGNAL);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                watchFd(epollFd, fd, EPOLLOUT);
+                return;
+            }
+            failReply(name, channel, std::string("send failed: ") + strerror(errno), false);
+            return;
+        }
+        channel.sent += n;
+    }
     
-    if (n < 0) {
-        logWithTimestamp("Failed to read response from socket");
-        close(sockfd);
-        return;
+    logWithTimestamp(LOG_DEBUG, "Sent JSON payload to socket (" + std::to_string(channel.sent) + " bytes written)");
+    watchFd(epollFd, fd, EPOLLIN | EPOLLRDHUP);
+}
+
+void ReplyDispatcher::readAck(const std::string& name, Channel& channel) {
+    // Read exactly "RESP" so the next reply on this connection starts cleanly
+    char buffer[4];
+    while (channel.ack.size() < sizeof(buffer)) {
+        ssize_t n = recv(channel.connection.fd, buffer, sizeof(buffer) - channel.ack.size(), 0);
+        if (n < 0 && errno == EINTR) continue;
+        if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) return;
+        if (n <= 0) {
+            failReply(name, channel, n == 0 ? "socket closed before response" : "failed to read response", false);
+            return;
+        }
+        channel.ack.append(buffer, n);
+    }
+    finishReply(name, channel);
+}
+
+void ReplyDispatcher::finishReply(const std::string& name, Channel& channel) {
+    bool expected = (channel.ack == "RESP");
+    if (expected) {
+        logWithTimestamp(LOG_DEBUG, "Received expected response: " + channel.ack);
+    } else {
+        logWithTimestamp(LOG_WARN, "Unexpected response from socket: " + channel.ack + " (expected 'RESP')");
     }
     
-    responseBuffer[n] = '\0';
-    std::string responseStr(responseBuffer, n);
+    epoll_ctl(epollFd, EPOLL_CTL_DEL, channel.connection.fd, NULL);
+    fdChannels.erase(channel.connection.fd);
+    RuntimeConnectionPool::instance().release(name, channel.connection, expected);
+    channel.connection = RuntimeConnection();
+    channel.inFlight = false;
     
-    logWithTimestamp("Received " + std::to_string(n) + " bytes from socket");
-    logWithTimestamp("Response content: " + responseStr);
+    const ReplyOrigin& origin = channel.queue.front().origin;
+    countMetric("replies_delivered");
+    if (!origin.action.empty()) {
+        recordMetric("reply_latency_us." + origin.action, elapsedMicros(origin.received));
+    }
+    channel.queue.pop_front();
+}
+
+// Close the attempt and schedule a retry with exponential backoff, or give up. When the
+// runtime cannot be reached at all, everything queued for it is dropped with the reply.
+void ReplyDispatcher::failReply(const std::string& name, Channel& channel, const std::string& reason,
+                                bool unreachable) {
+    if (channel.connection.fd >= 0) {
+        epoll_ctl(epollFd, EPOLL_CTL_DEL, channel.connection.fd, NULL);
+        fdChannels.erase(channel.connection.fd);
+        RuntimeConnectionPool::instance().release(name, channel.connection, false);
+        channel.connection = RuntimeConnection();
+    }
+    channel.inFlight = false;
     
-    if (responseStr != "RESP") {
-        logWithTimestamp("Unexpected response from socket: " + responseStr + " (expected 'RESP')");
-    } else {
-        logWithTimestamp("Received expected response: " + responseStr);
+    auto now = std::chrono::steady_clock::now();
+    OutboundReply& reply = channel.queue.front();
+    reply.attempts++;
+    countMetric("reply_failures");
+    if (reply.attempts > options.retries) {
+        countMetric("replies_dropped", unreachable ? channel.queue.size() : 1);
+        if (unreachable) {
+            logWithTimestamp(LOG_WARN, "Dropping " + std::to_string(channel.queue.size()) + " reply(s) to unreachable runtime " +
+                             name + " (" + reason + ")");
+            channel.queue.clear();
+        } else {
+            logWithTimestamp(LOG_WARN, "Dropping reply to " + name + " after " + std::to_string(reply.attempts) +
+                             " attempt(s) (" + reason + ")");
+            channel.queue.pop_front();
+        }
+        channel.retryAt = now;
+        return;
     }
     
-    close(sockfd);
+    long backoffMs = (long)options.backoffMs << std::min(reply.attempts - 1, 16);
+    channel.retryAt = now + std::chrono::milliseconds(backoffMs);
+    logWithTimestamp(LOG_WARN, "Reply to " + name + " failed (" + reason + "), retrying in " + std::to_string(backoffMs) + " ms");
 }
 
-// Process desktop owner settings request
-void processDOS(const std::string& runtimeSocketName, const std::string& messageId,
-                const std::string& socketPath, const std::string& manifestUrl) {
-    json response = {
+// Send to runtime socket: the reply is queued for the ReplyDispatcher's I/O thread
+void sendToRuntime(const std::string& runtimeSocketName, const json& payload, const std::string& socketPath,
+                   const ReplyOrigin& origin) {
+    // Create message: socketPath:S:jsonData
+    ReplyDispatcher::instance().enqueue(runtimeSocketName, socketPath + ":S:" + payload.dump(), origin);
+}
+
+// Desktop owner settings reply for manifestUrl
+json desktopOwnerSettingsResponse(const std::string& messageId, const std::string& manifestUrl) {
+    return {
         {"messageId", messageId},
         {"topic", "application"},
         {"payload", {
@@ -382,14 +4782,10 @@ void processDOS(const std::string& runtimeSocketName, const std::string& message
             }}
         }}
     };
-    
-    sendToRuntime(runtimeSocketName, response, socketPath);
-    logWithTimestamp("Created DOS response");
 }
-
-// Process RVM info request
-void processRVMInfo(const std::string& runtimeSocketName, const std::string& messageId,
-                    const std::string& socketPath, const std::string& manifestUrl) {
+
+// RVM info reply
+json rvmInfoResponse(const std::string& messageId) {
     char execPathBuf[1024];
     ssize_t len = readlink("/proc/self/exe", execPathBuf, sizeof(execPathBuf) - 1);
     
@@ -403,7 +4799,7 @@ void processRVMInfo(const std::string& runtimeSocketName, const std::string& mes
     std::string execDir = (pos != std::string::npos) ? execPath.substr(0, pos) : ".";
     std::string rvmPath = execDir + "/rvm-cpp";
     
-    json response = {
+    return {
         {"broadcast", false},
         {"messageId", messageId},
         {"topic", "system"},
@@ -417,88 +4813,590 @@ void processRVMInfo(const std::string& runtimeSocketName, const std::string& mes
             {"working-dir", execDir}
         }}
     };
+}
+
+// Stands in for messageId while a template is serialized
+const std::string MESSAGE_ID_PLACEHOLDER = "@rvm-message-id@";
+
+static ResponseTemplate makeResponseTemplate(const std::string& socketPath, const json& response) {
+    std::string message = socketPath + ":S:" + response.dump();
+    size_t pos = message.find("\"" + MESSAGE_ID_PLACEHOLDER + "\"");
+    
+    ResponseTemplate result;
+    result.prefix = message.substr(0, pos + 1);
+    result.suffix = message.substr(pos + 1 + MESSAGE_ID_PLACEHOLDER.size());
+    return result;
+}
+
+// Escapes value the way json::dump() does
+static void appendJsonEscaped(std::string& out, const std::string& value) {
+    static const char hex[] = "0123456789abcdef";
+    for (unsigned char c : value) {
+        switch (c) {
+            case '"': out += "\\\""; break;
+            case '\\': out += "\\\\"; break;
+            case '\b': out += "\\b"; break;
+            case '\f': out += "\\f"; break;
+            case '\n': out += "\\n"; break;
+            case '\r': out += "\\r"; break;
+            case '\t': out += "\\t"; break;
+            default:
+                if (c < 0x20) {
+                    out += "\\u00";
+                    out += hex[c >> 4];
+                    out += hex[c & 0xf];
+                } else {
+                    out += (char)c;
+                }
+        }
+    }
+}
+
+std::string ResponseTemplate::render(const std::string& messageId) const {
+    std::string message;
+    message.reserve(prefix.size() + messageId.size() + 8 + suffix.size());
+    message += prefix;
+    appendJsonEscaped(message, messageId);
+    message += suffix;
+    return message;
+}
+
+// ResponseTemplates
+ResponseTemplates& ResponseTemplates::instance() {
+    static ResponseTemplates* templates = new ResponseTemplates();
+    return *templates;
+}
+
+const ResponseTemplate& ResponseTemplates::desktopOwnerSettings(const std::string& socketPath,
+                                                                const std::string& manifestUrl) {
+    std::lock_guard<std::mutex> lock(mutex);
+    std::string key = socketPath + '\n' + manifestUrl;
+    auto it = dos.find(key);
+    if (it == dos.end()) {
+        json response = desktopOwnerSettingsResponse(MESSAGE_ID_PLACEHOLDER, manifestUrl);
+        it = dos.emplace(key, makeResponseTemplate(socketPath, response)).first;
+    }
+    return it->second;
+}
+
+const ResponseTemplate& ResponseTemplates::rvmInfo(const std::string& socketPath) {
+    std::lock_guard<std::mutex> lock(mutex);
+    auto it = rvm.find(socketPath);
+    if (it == rvm.end()) {
+        json response = rvmInfoResponse(MESSAGE_ID_PLACEHOLDER);
+        it = rvm.emplace(socketPath, makeResponseTemplate(socketPath, response)).first;
+    }
+    return it->second;
+}
+
+// Process desktop owner settings request
+void processDOS(const std::string& runtimeSocketName, const std::string& messageId,
+                const std::string& socketPath, const std::string& manifestUrl, const ReplyOrigin& origin) {
+    const ResponseTemplate& response = ResponseTemplates::instance().desktopOwnerSettings(socketPath, manifestUrl);
+    ReplyDispatcher::instance().enqueue(runtimeSocketName, response.render(messageId), origin);
+    logWithTimestamp(LOG_DEBUG, "Created DOS response");
+}
+
+// Process RVM info request
+void processRVMInfo(const std::string& runtimeSocketName, const std::string& messageId,
+                    const std::string& socketPath, const std::string& manifestUrl, const ReplyOrigin& origin) {
+    const ResponseTemplate& response = ResponseTemplates::instance().rvmInfo(socketPath);
+    ReplyDispatcher::instance().enqueue(runtimeSocketName, response.render(messageId), origin);
+    logWithTimestamp(LOG_DEBUG, "Created RVMInfo response");
+}
+
+// Process metrics request: replies with a snapshot of every counter and histogram
+void processMetrics(const std::string& runtimeSocketName, const std::string& messageId,
+                    const std::string& socketPath, const ReplyOrigin& origin) {
+    json response = {
+        {"messageId", messageId},
+        {"topic", "system"},
+        {"payload", {
+            {"action", "get-rvm-metrics"},
+            {"success", true},
+            {"metrics", Metrics::instance().snapshot()},
+            {"processes", ProcessSupervisor::instance().snapshot()}
+        }}
+    };
+    
+    sendToRuntime(runtimeSocketName, response, socketPath, origin);
+    logWithTimestamp(LOG_DEBUG, "Created metrics response");
+}
+
+// Cursor over a message body for scanMessageRoute(). Values that are not routing
+// fields are skipped over without being decoded.
+struct JsonScanner {
+    const char* p;
+    const char* end;
+    
+    void skipSpace() {
+        while (p < end && (*p == ' ' || *p == '\t' || *p == '\n' || *p == '\r')) p++;
+    }
+    
+    bool consume(char c) {
+        skipSpace();
+        if (p == end || *p != c) return false;
+        p++;
+        return true;
+    }
+    
+    // A string at the cursor, decoded into out (or skipped if out is null).
+    // \u escapes are left to the full parser.
+    bool readString(std::string* out) {
+        if (!consume('"')) return false;
+        while (p < end) {
+            const char* run = p;
+            while (p < end && *p != '"' && *p != '\\') p++;
+            if (out) out->append(run, p - run);
+            if (p == end) return false;
+            if (*p++ == '"') return true;
+            if (p == end) return false;
+            char c = *p++;
+            if (!out) continue;
+            switch (c) {
+                case '"': case '\\': case '/': *out += c; break;
+                case 'b': *out += '\b'; break;
+                case 'f': *out += '\f'; break;
+                case 'n': *out += '\n'; break;
+                case 'r': *out += '\r'; break;
+                case 't': *out += '\t'; break;
+                default: return false;
+            }
+        }
+        return false;
+    }
+    
+    bool skipValue() {
+        skipSpace();
+        if (p == end) return false;
+        if (*p == '"') return readString(nullptr);
+        if (*p != '{' && *p != '[') {
+            const char* start = p;
+            while (p < end && *p != ',' && *p != '}' && *p != ']' &&
+                   *p != ' ' && *p != '\t' && *p != '\n' && *p != '\r') p++;
+            return p > start;
+        }
+        int depth = 0;
+        while (p < end) {
+            char c = *p;
+            if (c == '"') {
+                if (!readString(nullptr)) return false;
+                continue;
+            }
+            p++;
+            if (c == '{' || c == '[') {
+                depth++;
+            } else if ((c == '}' || c == ']') && --depth == 0) {
+                return true;
+            }
+        }
+        return false;
+    }
+    
+    // Walk the members of the object at the cursor; member(key) reads or skips the
+    // value and returns false to abort. Stops early once done() is true.
+    template <typename Member, typename Done>
+    bool forEachMember(Member member, Done done) {
+        if (!consume('{')) return false;
+        if (consume('}')) return true;
+        std::string key;
+        do {
+            key.clear();
+            if (!readString(&key) || !consume(':') || !member(key)) return false;
+            if (done()) return true;
+        } while (consume(','));
+        return consume('}');
+    }
+};
+
+// Pick topic, messageId and payload.action out of a message body without building a
+// json tree; values of other members, such as large payloads, are skipped unparsed.
+// Returns false for anything it does not handle (malformed JSON, non-string fields,
+// a missing payload, \u escapes), which parseMessageRoute() then deals with.
+bool scanMessageRoute(const char* body, size_t len, MessageRoute& route) {
+    JsonScanner scanner{body, body + len};
+    bool topic = false, messageId = false, payload = false;
+    
+    auto isString = [&scanner]() {
+        scanner.skipSpace();
+        return scanner.p < scanner.end && *scanner.p == '"';
+    };
+    auto allFound = [&]() { return topic && messageId && payload; };
+    
+    return scanner.forEachMember([&](const std::string& key) {
+        if (key == "topic") {
+            topic = true;
+            route.topic.clear();
+            return isString() && scanner.readString(&route.topic);
+        }
+        if (key == "messageId") {
+            messageId = true;
+            route.messageId.clear();
+            return isString() && scanner.readString(&route.messageId);
+        }
+        if (key != "payload") {
+            return scanner.skipValue();
+        }
+        payload = true;
+        route.action.clear();
+        bool action = false;
+        // Leave the rest of the payload unread once every routing field is known
+        return scanner.forEachMember([&](const std::string& payloadKey) {
+            if (payloadKey != "action") return scanner.skipValue();
+            action = true;
+            route.action.clear();
+            return isString() && scanner.readString(&route.action);
+        }, [&]() { return action && allFound(); });
+    }, allFound) && payload;
+}
+
+// Routing fields from a full parse of the message body; throws on malformed JSON
+MessageRoute parseMessageRoute(const char* body, size_t len) {
+    auto jsonObj = json::parse(body, body + len);
     
-    sendToRuntime(runtimeSocketName, response, socketPath);
-    logWithTimestamp("Created RVMInfo response");
+    MessageRoute route;
+    route.topic = jsonObj.value("topic", "");
+    route.messageId = jsonObj.value("messageId", "");
+    route.action = jsonObj["payload"].value("action", "");
+    return route;
 }
 
 // Process incoming message
-void processMessage(const std::string& message, const std::string& socketPath, const std::string& manifestUrl) {
+void processMessage(const std::string& message, const std::string& socketPath, const std::string& manifestUrl,
+                    std::chrono::steady_clock::time_point received) {
     size_t pos = message.find(":S:");
     if (pos == std::string::npos) {
-        logWithTimestamp("Invalid message format: expected 'messageId:S:jsonString'");
+        countMetric("messages_invalid");
+        logWithTimestamp(LOG_WARN, "Invalid message format: expected 'messageId:S:jsonString'");
         return;
     }
     
     std::string runtimeSocketName = message.substr(0, pos);
-    std::string jsonString = message.substr(pos + 3);
+    const char* body = message.data() + pos + 3;
+    size_t bodyLength = message.size() - pos - 3;
     
     try {
-        auto jsonObj = json::parse(jsonString);
-        
-        std::string topic = jsonObj.value("topic", "");
-        std::string messageId = jsonObj.value("messageId", "");
-        std::string action = jsonObj["payload"].value("action", "");
+        // No handled action reads the body, so a full parse is only needed for
+        // messages the scanner cannot vouch for
+        MessageRoute route;
+        if (!scanMessageRoute(body, bodyLength, route)) {
+            route = parseMessageRoute(body, bodyLength);
+        }
         
-        logWithTimestamp("Runtime Scoket Name: " + runtimeSocketName);
-        logWithTimestamp("Topic: " + topic);
-        logWithTimestamp("Payload Message ID: " + messageId);
-        logWithTimestamp("Action: " + action);
+        logWithTimestamp(LOG_DEBUG, "Runtime Scoket Name: " + runtimeSocketName);
+        logWithTimestamp(LOG_DEBUG, "Topic: " + route.topic);
+        logWithTimestamp(LOG_DEBUG, "Payload Message ID: " + route.messageId);
+        logWithTimestamp(LOG_DEBUG, "Action: " + route.action);
         
-        if (action == "get-desktop-owner-settings") {
-            processDOS(runtimeSocketName, messageId, socketPath, manifestUrl);
-        } else if (action == "get-rvm-info") {
-            processRVMInfo(runtimeSocketName, messageId, socketPath, manifestUrl);
+        ReplyOrigin origin{route.action, received};
+        if (route.action == "get-desktop-owner-settings") {
+            processDOS(runtimeSocketName, route.messageId, socketPath, manifestUrl, origin);
+        } else if (route.action == "get-rvm-info") {
+            processRVMInfo(runtimeSocketName, route.messageId, socketPath, manifestUrl, origin);
+        } else if (route.action == "get-rvm-metrics") {
+            processMetrics(runtimeSocketName, route.messageId, socketPath, origin);
+        } else if (route.action == "launch-manifests") {
+            processLaunchRequest(body, bodyLength);
+        } else {
+            countMetric("messages.other");
+            return;
         }
+        countMetric("messages." + route.action);
     } catch (const std::exception& e) {
-        logWithTimestamp("Failed to parse JSON: " + std::string(e.what()));
+        countMetric("messages_invalid");
+        logWithTimestamp(LOG_ERROR, "Failed to parse JSON: " + std::string(e.what()));
     }
 }
 
-// Handle connection
-void handleConnection(int clientFd, const std::string& socketPath, const std::string& manifestUrl) {
-    char buffer[1024 * 1024];
-    
-    ssize_t n = recv(clientFd, buffer, sizeof(buffer) - 1, 0);
-    if (n <= 0) {
-        if (n < 0) {
-            logWithTimestamp("Error reading from connection");
+// Fetch, install and launch the manifests another rvm-cpp invocation handed over
+void processLaunchRequest(const char* body, size_t len) {
+    json message = json::parse(body, body + len);
+    std::vector<std::string> urls;
+    if (message.contains("payload") && message["payload"].contains("configs")) {
+        for (const auto& url : message["payload"]["configs"]) {
+            if (url.is_string() && !url.get<std::string>().empty()) {
+                urls.push_back(url.get<std::string>());
+            }
         }
-        logWithTimestamp("Connection closed");
-        close(clientFd);
+    }
+    if (urls.empty()) {
+        logWithTimestamp(LOG_WARN, "Invalid launch request: no configs");
         return;
     }
     
-    buffer[n] = '\0';
-    std::string message(buffer, n);
-    logWithTimestamp("Received message: " + message);
+    logWithTimestamp("Launch request for " + std::to_string(urls.size()) + " config(s)");
+    std::make_shared<LaunchPipeline>(urls, launchRequestOptions)->start();
+}
+
+// Hand urls to the rvm-cpp listening on socketPath; false if there is none or it did
+// not acknowledge the request
+bool forwardLaunchRequest(const std::string& socketPath, const std::vector<std::string>& urls) {
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0) return false;
+    
+    struct timeval timeout = {2, 0};
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+    setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
     
-    // Send acknowledgment
-    const char* response = "RESP";
-    ssize_t sent = send(clientFd, response, strlen(response), 0);
-    if (sent < 0) {
-        logWithTimestamp("Error writing response");
-        close(clientFd);
-        return;
+    struct sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strncpy(addr.sun_path, socketPath.c_str(), sizeof(addr.sun_path) - 1);
+    if (connect(fd, (struct sockaddr*)&addr, sizeof(addr)) < 0) {
+        close(fd);
+        return false;
     }
     
-    logWithTimestamp("Sent response: RESP (" + std::to_string(sent) + " bytes written)");
+    json request = {
+        {"messageId", "launch-" + std::to_string(getpid())},
+        {"topic", "system"},
+        {"payload", {
+            {"action", "launch-manifests"},
+            {"configs", urls}
+        }}
+    };
+    std::string message = "rvm-cpp-" + std::to_string(getpid()) + ":S:" + request.dump();
     
-    // Process message
-    processMessage(message, socketPath, manifestUrl);
+    bool acknowledged = false;
+    if (send(fd, message.data(), message.size(), MSG_NOSIGNAL) == (ssize_t)message.size()) {
+        char ack[4];
+        size_t received = 0;
+        while (received < sizeof(ack)) {
+            ssize_t n = recv(fd, ack + received, sizeof(ack) - received, 0);
+            if (n <= 0) break;
+            received += n;
+        }
+        acknowledged = (received == sizeof(ack) && memcmp(ack, "RESP", 4) == 0);
+    }
+    close(fd);
     
-    close(clientFd);
+    if (!acknowledged) {
+        logWithTimestamp(LOG_WARN, "Running rvm-cpp on " + socketPath + " did not acknowledge the launch request");
+    }
+    return acknowledged;
 }
 
-// Start socket server
-void startSocketServer(const std::string& socketPath, const std::string& manifestUrl) {
-    // Remove existing socket
-    unlink(socketPath.c_str());
+// WorkerPool
+WorkerPool::WorkerPool(int threads, size_t maxQueued, int notifyFd)
+    : maxQueued(std::max<size_t>(1, maxQueued)), notifyFd(notifyFd) {
+    for (int i = 0; i < std::max(1, threads); i++) {
+        workers.emplace_back(&WorkerPool::run, this);
+    }
+}
+
+WorkerPool::~WorkerPool() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    ready.notify_all();
+    for (auto& worker : workers) {
+        worker.join();
+    }
+}
+
+bool WorkerPool::tryPost(std::function<void()> task) {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (tasks.size() >= maxQueued) return false;
+        tasks.push_back(std::move(task));
+    }
+    ready.notify_one();
+    return true;
+}
+
+void WorkerPool::run() {
+    while (true) {
+        std::function<void()> task;
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            ready.wait(lock, [this] { return stopping || !tasks.empty(); });
+            if (tasks.empty()) return;
+            bool wasFull = tasks.size() >= maxQueued;
+            task = std::move(tasks.front());
+            tasks.pop_front();
+            if (wasFull && notifyFd >= 0) {
+                uint64_t one = 1;
+                ssize_t ignored = write(notifyFd, &one, sizeof(one));
+                (void)ignored;
+            }
+        }
+        
+        try {
+            task();
+        } catch (const std::exception& e) {
+            logWithTimestamp(std::string("Worker task failed: ") + e.what());
+        }
+    }
+}
+
+// BufferPool
+std::string BufferPool::acquire(size_t minCapacity) {
+    size_t sizeClass = MIN_CLASS;
+    while (sizeClass < minCapacity) sizeClass <<= 1;
+    
+    auto& list = freeLists[sizeClass];
+    if (!list.empty()) {
+        std::string buffer = std::move(list.back());
+        list.pop_back();
+        return buffer;
+    }
+    std::string buffer;
+    buffer.reserve(sizeClass);
+    return buffer;
+}
+
+void BufferPool::release(std::string&& buffer) {
+    size_t capacity = buffer.capacity();
+    if (capacity < MIN_CLASS || capacity > MAX_POOLED) return;
+    
+    size_t sizeClass = MIN_CLASS;
+    while (sizeClass * 2 <= capacity) sizeClass <<= 1;
+    auto& list = freeLists[sizeClass];
+    if (list.size() < PER_CLASS) {
+        buffer.clear();
+        list.push_back(std::move(buffer));
+    }
+}
+
+// MessageFramer
+MessageFramer::MessageFramer(BufferPool& pool) : pool(pool) {}
+
+MessageFramer::~MessageFramer() {
+    pool.release(std::move(buffer));
+}
+
+void MessageFramer::append(const char* data, size_t len) {
+    if (buffer.empty()) {
+        buffer = pool.acquire(len);
+    }
+    buffer.append(data, len);
+}
+
+void MessageFramer::consume(size_t len) {
+    buffer.erase(0, len);
+    scanned = scanned > len ? scanned - len : 0;
+    if (buffer.empty()) {
+        pool.release(std::move(buffer));
+        buffer = std::string();
+    }
+}
+
+MessageFramer::Status MessageFramer::next(std::string& message) {
+    if (bodyStart == std::string::npos) {
+        // Whitespace between pipelined messages is not part of the next socket name
+        size_t first = buffer.find_first_not_of(" \t\r\n");
+        if (first != 0) consume(first == std::string::npos ? buffer.size() : first);
+        
+        size_t from = scanned >= 2 ? scanned - 2 : 0;
+        size_t marker = buffer.find(":S:", from);
+        size_t newline = buffer.find('\n', from);
+        if (newline < marker) {
+            return takeLine(newline, message);
+        }
+        if (marker == std::string::npos) {
+            scanned = buffer.size();
+            return buffer.size() > MAX_SOCKET_MESSAGE_SIZE ? INVALID : NEED_MORE;
+        }
+        bodyStart = marker + 3;
+        scanned = bodyStart;
+    }
+    
+    for (; scanned < buffer.size(); scanned++) {
+        char c = buffer[scanned];
+        if (inString) {
+            if (escaped) {
+                escaped = false;
+            } else if (c == '\\') {
+                escaped = true;
+            } else if (c == '"') {
+                inString = false;
+            }
+        } else if (depth == 0 && c != '{') {
+            if (c != ' ' && c != '\t' && c != '\r') {
+                return takeLine(buffer.find('\n', scanned), message);
+            }
+        } else if (c == '"') {
+            inString = true;
+        } else if (c == '{') {
+            depth++;
+        } else if (c == '}' && --depth == 0) {
+            size_t len = scanned + 1;
+            message.assign(buffer, 0, len);
+            bodyStart = std::string::npos;
+            consume(len);
+            scanned = 0;
+            return MESSAGE;
+        }
+    }
+    return buffer.size() > MAX_SOCKET_MESSAGE_SIZE ? INVALID : NEED_MORE;
+}
+
+MessageFramer::Status MessageFramer::takeLine(size_t end, std::string& message) {
+    size_t len = end == std::string::npos ? buffer.size() : end;
+    message.assign(buffer, 0, len);
+    consume(end == std::string::npos ? len : len + 1);
+    scanned = 0;
+    bodyStart = std::string::npos;
+    return MESSAGE;
+}
+
+std::string MessageFramer::takeRemainder() {
+    std::string rest = std::move(buffer);
+    buffer = std::string();
+    scanned = 0;
+    bodyStart = std::string::npos;
+    depth = 0;
+    inString = false;
+    escaped = false;
+    return rest;
+}
+
+// State of one client of the messaging server's event loop
+struct ClientConnection {
+    explicit ClientConnection(BufferPool& pool) : framer(pool) {}
+    
+    int fd = -1;
+    // Manifest DOS replies are built from: the connecting application's own
+    std::string manifestUrl;
+    MessageFramer framer;
+    // Framed message waiting for room in the worker queue, and when it was framed
+    std::string held;
+    bool holding = false;
+    std::chrono::steady_clock::time_point heldSince;
+    std::string output;
+    size_t outputSent = 0;
+    bool peerClosed = false;
+    uint32_t events = 0;
+    std::chrono::steady_clock::time_point lastActive;
+};
+
+// Whether something is listening on the unix socket at path
+static bool socketAcceptsConnections(const std::string& path) {
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (fd < 0) return false;
+    
+    struct sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strncpy(addr.sun_path, path.c_str(), sizeof(addr.sun_path) - 1);
     
-    int serverFd = socket(AF_UNIX, SOCK_STREAM, 0);
+    // A listener with a full backlog still counts as alive
+    bool live = connect(fd, (struct sockaddr*)&addr, sizeof(addr)) == 0 || errno == EAGAIN;
+    close(fd);
+    return live;
+}
+
+// Start socket server: a single epoll loop accepts clients, frames their messages
+// without blocking and hands each message to a bounded pool of workers. Clients
+// get one RESP per message and may keep the connection open for further messages.
+SocketServerResult startSocketServer(const std::string& socketPath, const std::string& manifestUrl,
+                                     const SocketServerOptions& options,
+                                     const std::function<void()>& onListening) {
+    int serverFd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
     if (serverFd < 0) {
-        logWithTimestamp("Failed to create socket");
-        return;
+        logWithTimestamp(LOG_ERROR, "Failed to create socket");
+        return SOCKET_SERVER_FAILED;
     }
     
     struct sockaddr_un addr;
@@ -506,35 +5404,257 @@ void startSocketServer(const std::string& socketPath, const std::string& manifes
     addr.sun_family = AF_UNIX;
     strncpy(addr.sun_path, socketPath.c_str(), sizeof(addr.sun_path) - 1);
     
-    if (bind(serverFd, (struct sockaddr*)&addr, sizeof(addr)) < 0) {
-        logWithTimestamp("Failed to bind socket");
+    // A socket file left by an instance that is gone is replaced; a live one is not
+    int bound = bind(serverFd, (struct sockaddr*)&addr, sizeof(addr));
+    if (bound < 0 && errno == EADDRINUSE) {
+        if (socketAcceptsConnections(socketPath)) {
+            logWithTimestamp(LOG_ERROR, "Failed to bind socket: another rvm-cpp is listening on " + socketPath);
+            close(serverFd);
+            return SOCKET_SERVER_IN_USE;
+        }
+        unlink(socketPath.c_str());
+        bound = bind(serverFd, (struct sockaddr*)&addr, sizeof(addr));
+    }
+    if (bound < 0) {
+        logWithTimestamp(LOG_ERROR, "Failed to bind socket");
         close(serverFd);
-        return;
+        return SOCKET_SERVER_FAILED;
     }
     
-    if (listen(serverFd, 50) < 0) {
-        logWithTimestamp("Failed to listen on socket");
+    if (listen(serverFd, SOMAXCONN) < 0) {
+        logWithTimestamp(LOG_ERROR, "Failed to listen on socket");
         close(serverFd);
-        return;
+        return SOCKET_SERVER_FAILED;
     }
     
+    int epollFd = epoll_create1(EPOLL_CLOEXEC);
+    int wakeFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (epollFd < 0 || wakeFd < 0) {
+        logWithTimestamp(LOG_ERROR, "Failed to set up socket event loop");
+        if (epollFd >= 0) close(epollFd);
+        if (wakeFd >= 0) close(wakeFd);
+        close(serverFd);
+        return SOCKET_SERVER_FAILED;
+    }
+    watchFd(epollFd, serverFd, EPOLLIN);
+    watchFd(epollFd, wakeFd, EPOLLIN);
+    
+    WorkerPool workers(options.workerThreads, options.maxQueuedMessages, wakeFd);
+    BufferPool buffers;
+    std::vector<char> scratch(65536);
+    std::unordered_map<int, std::unique_ptr<ClientConnection>> clients;
+    std::deque<int> parked;
+    bool accepting = true;
+    size_t maxConnections = std::max(1, options.maxConnections);
+    auto idleTimeout = std::chrono::milliseconds(options.idleTimeoutMs);
+    auto lastSweep = std::chrono::steady_clock::now();
+    
+    // Serialize the fixed replies before the first request needs them
+    ResponseTemplates::instance().desktopOwnerSettings(socketPath, manifestUrl);
+    ResponseTemplates::instance().rvmInfo(socketPath);
+    
     logWithTimestamp("Socket server listening on: " + socketPath);
+    if (onListening) onListening();
+    
+    auto closeClient = [&](ClientConnection& client) {
+        epoll_ctl(epollFd, EPOLL_CTL_DEL, client.fd, NULL);
+        close(client.fd);
+        clients.erase(client.fd);
+        if (!accepting && clients.size() < maxConnections) {
+            watchFd(epollFd, serverFd, EPOLLIN);
+            accepting = true;
+        }
+    };
+    
+    // Write pending responses; returns false if the client was closed
+    auto flushClient = [&](ClientConnection& client) {
+        while (client.outputSent < client.output.size()) {
+            ssize_t sent = send(client.fd, client.output.data() + client.outputSent,
+                                client.output.size() - client.outputSent, MSG_NOSIGNAL);
+            if (sent < 0) {
+                if (errno == EINTR) continue;
+                if (errno == EAGAIN || errno == EWOULDBLOCK) break;
+                logWithTimestamp(LOG_ERROR, "Error writing response");
+                closeClient(client);
+                return false;
+            }
+            client.outputSent += sent;
+        }
+        if (!client.output.empty() && client.outputSent == client.output.size()) {
+            logWithTimestamp(LOG_DEBUG, "Sent response: RESP (" + std::to_string(client.outputSent) + " bytes written)");
+            client.output.clear();
+            client.outputSent = 0;
+        }
+        
+        if (client.peerClosed && client.output.empty() && !client.holding) {
+            logWithTimestamp(LOG_DEBUG, "Connection closed");
+            closeClient(client);
+            return false;
+        }
+        
+        uint32_t events = client.peerClosed ? 0 : (EPOLLIN | EPOLLRDHUP);
+        if (!client.output.empty()) events |= EPOLLOUT;
+        if (events != client.events) {
+            watchFd(epollFd, client.fd, events);
+            client.events = events;
+        }
+        return true;
+    };
+    
+    // Queue every complete message and acknowledge it. Returns true if the client
+    // had to be parked because the worker queue is full.
+    auto processInput = [&](ClientConnection& client) {
+        while (true) {
+            if (!client.holding) {
+                MessageFramer::Status status = client.framer.next(client.held);
+                if (status == MessageFramer::INVALID) {
+                    logWithTimestamp(LOG_WARN, "Message larger than " + std::to_string(MAX_SOCKET_MESSAGE_SIZE) +
+                                     " bytes on connection, closing it");
+                    closeClient(client);
+                    return false;
+                }
+                if (status == MessageFramer::NEED_MORE) {
+                    if (!client.peerClosed || client.framer.pending() == 0) break;
+                    // Peer closed after an unterminated message: pass it on as it is
+                    client.held = client.framer.takeRemainder();
+                }
+                client.holding = true;
+                client.heldSince = std::chrono::steady_clock::now();
+                if (logEnabled(LOG_DEBUG)) {
+                    logWithTimestamp(LOG_DEBUG, "Received message: " + client.held);
+                }
+            }
+            
+            auto message = std::make_shared<std::string>(std::move(client.held));
+            auto received = client.heldSince;
+            if (!workers.tryPost([message, socketPath, manifestUrl = client.manifestUrl, received]() {
+                    processMessage(*message, socketPath, manifestUrl, received);
+                })) {
+                client.held = std::move(*message);
+                // Stop watching the client until a worker frees a slot
+                epoll_ctl(epollFd, EPOLL_CTL_DEL, client.fd, NULL);
+                client.events = ~0u;
+                return true;
+            }
+            client.holding = false;
+            client.output += "RESP";
+        }
+        flushClient(client);
+        return false;
+    };
+    
+    auto readClient = [&](ClientConnection& client) {
+        while (true) {
+            ssize_t n = recv(client.fd, scratch.data(), scratch.size(), 0);
+            if (n > 0) {
+                client.framer.append(scratch.data(), n);
+                continue;
+            }
+            if (n == 0) {
+                client.peerClosed = true;
+            } else if (errno == EINTR) {
+                continue;
+            } else if (errno != EAGAIN && errno != EWOULDBLOCK) {
+                logWithTimestamp(LOG_ERROR, "Error reading from connection");
+                client.peerClosed = true;
+            }
+            break;
+        }
+        client.lastActive = std::chrono::steady_clock::now();
+        
+        if (processInput(client)) {
+            parked.push_back(client.fd);
+        }
+    };
     
+    std::vector<struct epoll_event> events(64);
     while (true) {
-        int clientFd = accept(serverFd, NULL, NULL);
-        if (clientFd < 0) {
-            logWithTimestamp("Error accepting connection");
-            continue;
+        int count = epoll_wait(epollFd, events.data(), (int)events.size(), clients.empty() ? -1 : 1000);
+        if (count < 0) {
+            if (errno == EINTR) continue;
+            logWithTimestamp(std::string("Socket event loop failed: ") + strerror(errno));
+            break;
         }
         
-        logWithTimestamp("New connection established");
+        for (int i = 0; i < count; i++) {
+            int fd = events[i].data.fd;
+            
+            if (fd == serverFd) {
+                while (clients.size() < maxConnections) {
+                    int clientFd = accept4(serverFd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+                    if (clientFd < 0) {
+                        if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) {
+                            logWithTimestamp(LOG_ERROR, "Error accepting connection");
+                        }
+                        break;
+                    }
+                    logWithTimestamp(LOG_DEBUG, "New connection established");
+                    std::unique_ptr<ClientConnection> client(new ClientConnection(buffers));
+                    client->fd = clientFd;
+                    struct ucred peer;
+                    socklen_t peerLength = sizeof(peer);
+                    if (getsockopt(clientFd, SOL_SOCKET, SO_PEERCRED, &peer, &peerLength) == 0) {
+                        client->manifestUrl = ProcessSupervisor::instance().manifestUrlOf(peer.pid);
+                    }
+                    if (client->manifestUrl.empty()) {
+                        client->manifestUrl = manifestUrl;
+                    }
+                    client->events = EPOLLIN | EPOLLRDHUP;
+                    client->lastActive = std::chrono::steady_clock::now();
+                    watchFd(epollFd, clientFd, client->events);
+                    clients[clientFd] = std::move(client);
+                }
+                if (clients.size() >= maxConnections && accepting) {
+                    // Leave further clients in the backlog until a connection closes
+                    watchFd(epollFd, serverFd, 0);
+                    accepting = false;
+                }
+            } else if (fd == wakeFd) {
+                uint64_t value;
+                ssize_t ignored = read(wakeFd, &value, sizeof(value));
+                (void)ignored;
+                while (!parked.empty()) {
+                    int parkedFd = parked.front();
+                    parked.pop_front();
+                    auto it = clients.find(parkedFd);
+                    if (it != clients.end() && processInput(*it->second)) {
+                        parked.push_front(parkedFd);
+                        break;
+                    }
+                }
+            } else {
+                auto it = clients.find(fd);
+                if (it == clients.end()) continue;
+                ClientConnection& client = *it->second;
+                if ((events[i].events & EPOLLOUT) && !flushClient(client)) continue;
+                if (events[i].events & (EPOLLIN | EPOLLRDHUP | EPOLLHUP | EPOLLERR)) {
+                    readClient(client);
+                }
+            }
+        }
         
-        // Handle in separate thread
-        std::thread(handleConnection, clientFd, socketPath, manifestUrl).detach();
+        auto now = std::chrono::steady_clock::now();
+        if (options.idleTimeoutMs > 0 && now - lastSweep >= std::chrono::seconds(1)) {
+            lastSweep = now;
+            std::vector<ClientConnection*> idle;
+            for (auto& entry : clients) {
+                ClientConnection& client = *entry.second;
+                if (!client.holding && client.output.empty() && now - client.lastActive > idleTimeout) {
+                    idle.push_back(&client);
+                }
+            }
+            for (ClientConnection* client : idle) {
+                logWithTimestamp("Closing idle connection");
+                closeClient(*client);
+            }
+        }
     }
     
+    close(wakeFd);
+    close(epollFd);
     close(serverFd);
     unlink(socketPath.c_str());
+    return SOCKET_SERVER_STOPPED;
 }
 
 // Utility functions
@@ -562,21 +5682,65 @@ bool fileExists(const std::string& path) {
     return access(path.c_str(), F_OK) == 0;
 }
 
+#ifndef RVM_CPP_NO_MAIN
+void printUsage() {
+    std::cerr << "Usage: rvm-cpp --config=<URL1>,<URL2>,... --runtime-dir=<directory> [options]" << std::endl;
+    std::cerr << "Options:" << std::endl;
+    std::cerr << "  --fetch-timeout=<ms>          Per-request manifest fetch timeout" << std::endl;
+    std::cerr << "  --no-manifest-cache           Always download manifests in full, never use the cache" << std::endl;
+    std::cerr << "  --stale-while-revalidate      Start from cached manifests and refresh them in the background" << std::endl;
+    std::cerr << "  --install-mode=file|stream    Extract runtimes from a temp file or while downloading" << std::endl;
+    std::cerr << "  --extract-threads=<n>         Extraction worker threads (0 = all cores)" << std::endl;
+    std::cerr << "  --dedup-store                 Share identical runtime files across versions" << std::endl;
+    std::cerr << "  --download-connections=<n>    Parallel ranged connections per runtime download" << std::endl;
+    std::cerr << "  --runtime-base-url=<url>      Runtime download location (default " << DEFAULT_RUNTIME_BASE_URL << ")" << std::endl;
+    std::cerr << "  --max-downloads=<n>           Runtime installs running at once (default 2)" << std::endl;
+    std::cerr << "  --no-launch                   Install runtimes but do not start applications" << std::endl;
+    std::cerr << "  --verify-installs=<mode>      Check installed runtimes before launch: off, quick or full (default quick)" << std::endl;
+    std::cerr << "  --require-runtime-digest      Verify archives without runtime.sha256 against <archive URL>.sha256" << std::endl;
+    std::cerr << "  --delta-updates               Build new runtimes from an installed one and a delta package when available" << std::endl;
+    std::cerr << "  --prefetch-interval=<s>       Re-check manifests and install new runtimes in the background (0 = off)" << std::endl;
+    std::cerr << "  --prefetch-config=<URL>,...   Manifests to prefetch for (default the --config list)" << std::endl;
+    std::cerr << "  --prefetch-max-rate=<bytes/s> Prefetch download rate (default 2 MB/s, 0 = unlimited)" << std::endl;
+    std::cerr << "  --max-connections=<n>         Concurrent messaging socket clients (default 256)" << std::endl;
+    std::cerr << "  --max-queued-messages=<n>     Messages waiting for a worker before reads pause (default 1024)" << std::endl;
+    std::cerr << "  --worker-threads=<n>          Threads handling messaging socket requests (default 4)" << std::endl;
+    std::cerr << "  --client-idle-timeout=<ms>    Disconnect silent messaging clients (default 60000, 0 = never)" << std::endl;
+    std::cerr << "  --reply-timeout=<ms>          Time a runtime has to acknowledge a reply (default 5000)" << std::endl;
+    std::cerr << "  --reply-retries=<n>           Redeliveries of an unacknowledged reply, with backoff (default 3)" << std::endl;
+    std::cerr << "  --log-level=<level>           debug, info, warn or error (default info)" << std::endl;
+    std::cerr << "  --log-file=<path>             Write the log to a file instead of stderr" << std::endl;
+    std::cerr << "  --log-max-size=<bytes>        Rotate the log file at this size (default 10 MB)" << std::endl;
+    std::cerr << "  --log-max-files=<n>           Rotated log files to keep (default 5)" << std::endl;
+}
+
 // Main function
 int main(int argc, char* argv[]) {
+    // Before any thread exists, so SIGCHLD is blocked in all of them
+    ProcessSupervisor::instance().start();
+    
     // Record start time
     auto now = std::time(nullptr);
-    auto tm = *std::localtime(&now);
+    struct tm tm;
+    localtime_r(&now, &tm);
     std::ostringstream oss;
     oss << std::put_time(&tm, "%Y-%m-%d %H:%M:%S");
     startTime = oss.str();
     
-    // Initialize CURL
-    curl_global_init(CURL_GLOBAL_ALL);
-    
     // Parse arguments
     std::string configURLs;
     std::string runtimeDir;
+    FetchOptions fetchOptions;
+    bool manifestCache = true;
+    InstallOptions installOptions;
+    bool dedupStore = false;
+    std::string runtimeBaseURL = DEFAULT_RUNTIME_BASE_URL;
+    SocketServerOptions serverOptions;
+    ReplyOptions replyOptions;
+    LogOptions logOptions;
+    PipelineOptions pipelineOptions;
+    PrefetchOptions prefetchOptions;
+    std::string prefetchURLs;
     
     for (int i = 1; i < argc; i++) {
         std::string arg = argv[i];
@@ -584,94 +5748,168 @@ int main(int argc, char* argv[]) {
             configURLs = arg.substr(9);
         } else if (arg.find("--runtime-dir=") == 0) {
             runtimeDir = arg.substr(14);
+        } else if (arg.find("--fetch-timeout=") == 0) {
+            fetchOptions.timeoutMs = std::stol(arg.substr(16));
+        } else if (arg == "--no-manifest-cache") {
+            manifestCache = false;
+        } else if (arg == "--stale-while-revalidate") {
+            fetchOptions.staleWhileRevalidate = true;
+        } else if (arg.find("--install-mode=") == 0) {
+            installOptions.streaming = (arg.substr(15) == "stream");
+        } else if (arg.find("--extract-threads=") == 0) {
+            installOptions.extractThreads = std::stoi(arg.substr(18));
+        } else if (arg == "--dedup-store") {
+            dedupStore = true;
+        } else if (arg.find("--download-connections=") == 0) {
+            installOptions.downloadConnections = std::stoi(arg.substr(23));
+        } else if (arg.find("--runtime-base-url=") == 0) {
+            runtimeBaseURL = arg.substr(19);
+        } else if (arg.find("--max-downloads=") == 0) {
+            pipelineOptions.maxDownloads = std::stoi(arg.substr(16));
+        } else if (arg == "--no-launch") {
+            pipelineOptions.launch = false;
+        } else if (arg.find("--verify-installs=") == 0) {
+            std::string mode = arg.substr(18);
+            if (mode == "off") {
+                installOptions.verify = VERIFY_OFF;
+            } else if (mode == "full") {
+                installOptions.verify = VERIFY_FULL;
+            } else {
+                installOptions.verify = VERIFY_QUICK;
+            }
+        } else if (arg == "--require-runtime-digest") {
+            installOptions.publishedDigest = true;
+        } else if (arg == "--delta-updates") {
+            installOptions.deltaUpdates = true;
+        } else if (arg.find("--prefetch-interval=") == 0) {
+            prefetchOptions.intervalSeconds = std::stoi(arg.substr(20));
+        } else if (arg.find("--prefetch-config=") == 0) {
+            prefetchURLs = arg.substr(18);
+        } else if (arg.find("--prefetch-max-rate=") == 0) {
+            prefetchOptions.maxBytesPerSec = std::stoll(arg.substr(20));
+        } else if (arg.find("--max-connections=") == 0) {
+            serverOptions.maxConnections = std::stoi(arg.substr(18));
+        } else if (arg.find("--max-queued-messages=") == 0) {
+            serverOptions.maxQueuedMessages = std::stoi(arg.substr(22));
+        } else if (arg.find("--worker-threads=") == 0) {
+            serverOptions.workerThreads = std::stoi(arg.substr(17));
+        } else if (arg.find("--client-idle-timeout=") == 0) {
+            serverOptions.idleTimeoutMs = std::stoi(arg.substr(22));
+        } else if (arg.find("--reply-timeout=") == 0) {
+            replyOptions.timeoutMs = std::stoi(arg.substr(16));
+        } else if (arg.find("--reply-retries=") == 0) {
+            replyOptions.retries = std::stoi(arg.substr(16));
+        } else if (arg.find("--log-level=") == 0) {
+            std::string level = arg.substr(12);
+            if (level == "debug") {
+                logOptions.level = LOG_DEBUG;
+            } else if (level == "warn") {
+                logOptions.level = LOG_WARN;
+            } else if (level == "error") {
+                logOptions.level = LOG_ERROR;
+            } else {
+                logOptions.level = LOG_INFO;
+            }
+        } else if (arg.find("--log-file=") == 0) {
+            logOptions.file = arg.substr(11);
+        } else if (arg.find("--log-max-size=") == 0) {
+            logOptions.maxFileSize = std::stoull(arg.substr(15));
+        } else if (arg.find("--log-max-files=") == 0) {
+            logOptions.maxFiles = std::stoi(arg.substr(16));
         }
     }
     
+    Logger::instance().configure(logOptions);
+    
     if (configURLs.empty()) {
         std::cerr << "Error: --config parameter is required" << std::endl;
-        std::cerr << "Usage: rvm-cpp --config=<URL1>,<URL2>,... --runtime-dir=<directory>" << std::endl;
-        return 1;
-    }
-    
-    if (runtimeDir.empty()) {
-        std::cerr << "Error: --runtime-dir parameter is required" << std::endl;
-        std::cerr << "Usage: rvm-cpp --config=<URL1>,<URL2>,... --runtime-dir=<directory>" << std::endl;
+        printUsage();
         return 1;
     }
     
     // Split config URLs
     auto configURLList = split(configURLs, ',');
-    std::vector<LaunchInfo> launchQueue;
     
-    // Process each config URL
+    std::vector<std::string> urls;
     for (const auto& configURL : configURLList) {
         std::string url = trim(configURL);
         if (url.empty()) continue;
-        
-        try {
-            // Fetch config
-            Config config = fetchConfig(url);
-            
-            if (config.version.empty()) {
-                logWithTimestamp("Error: runtime.version not found in config from " + url);
-                continue;
-            }
-            
-            logWithTimestamp("Runtime version: " + config.version + " for config: " + url);
-            
-            // Build runtime path
-            std::string runtimePath = runtimeDir + "/" + config.version + "/openfin";
-            
-            // Check if runtime exists
-            if (!fileExists(runtimePath)) {
-                logWithTimestamp("Runtime not found at path: " + runtimePath);
-                
-                std::string cpuArch = getCPUArch();
-                logWithTimestamp("Detected CPU architecture: " + cpuArch);
-                
-                std::string downloadURL = "https://cdn.openfin.co/release/runtime/linux/" + 
-                                         cpuArch + "/" + config.version;
-                
-                std::string targetDir = runtimeDir + "/" + config.version;
-                
-                try {
-                    downloadAndExtractRuntime(downloadURL, targetDir);
-                } catch (const std::exception& e) {
-                    logWithTimestamp("Failed to download and extract runtime: " + std::string(e.what()));
-                    continue;
-                }
-                
-                if (!fileExists(runtimePath)) {
-                    logWithTimestamp("Runtime still not found after extraction at path: " + runtimePath);
-                    continue;
-                }
-            }
-            
-            logWithTimestamp("Runtime ready at path: " + runtimePath);
-            
-            // Add to launch queue
-            launchQueue.push_back({runtimePath, url, config.arguments, config.version});
-            
-        } catch (const std::exception& e) {
-            logWithTimestamp("Error fetching config from " + url + ": " + e.what());
-            continue;
-        }
+        urls.push_back(url);
+    }
+    
+    // An rvm-cpp that is already running takes the manifests over, so launching
+    // another app costs one round trip on the messaging socket
+    std::string socketPath = "/tmp/OpenFinRVM_Messaging";
+    if (forwardLaunchRequest(socketPath, urls)) {
+        logWithTimestamp("Handed " + std::to_string(urls.size()) + " config(s) to the running rvm-cpp");
+        return 0;
+    }
+    
+    if (runtimeDir.empty()) {
+        std::cerr << "Error: --runtime-dir parameter is required" << std::endl;
+        printUsage();
+        return 1;
     }
     
-    // Launch all applications
-    logWithTimestamp("All runtimes downloaded. Launching " + std::to_string(launchQueue.size()) + " application(s)...");
+    // Initialize CURL
+    curl_global_init(CURL_GLOBAL_ALL);
+    
+    if (manifestCache) {
+        fetchOptions.cacheDir = runtimeDir + "/.manifest-cache";
+    }
+    if (dedupStore) {
+        installOptions.objectStoreDir = runtimeDir + "/.objects";
+    }
+    installOptions.downloadDir = runtimeDir + "/.downloads";
     
-    // for (const auto& info : launchQueue) {
-    //     std::thread(launchApplication, info.runtimePath, info.configURL, 
-    //                info.runtimeArgs, info.runtimeVersion).detach();
-    // }
+    pipelineOptions.runtimeDir = runtimeDir;
+    pipelineOptions.runtimeBaseURL = runtimeBaseURL;
+    pipelineOptions.fetch = fetchOptions;
+    pipelineOptions.install = installOptions;
+    launchRequestOptions = pipelineOptions;
     
-    // Start socket server
-    std::string socketPath = "/tmp/OpenFinRVM_Messaging";
+    // Prefetch watches the launched manifests unless given its own list
+    for (const auto& configURL : split(prefetchURLs, ',')) {
+        std::string url = trim(configURL);
+        if (!url.empty()) prefetchOptions.urls.push_back(url);
+    }
+    if (prefetchOptions.urls.empty()) {
+        prefetchOptions.urls = urls;
+    }
+    auto pipeline = std::make_shared<LaunchPipeline>(urls, pipelineOptions);
+    bool pipelineStarted = false;
+    
+    // Start socket server; runtimes talk to it on startup, so nothing is launched
+    // before it listens
     std::string firstConfigURL = trim(configURLList[0]);
-    startSocketServer(socketPath, firstConfigURL);
+    ReplyDispatcher::instance().start(replyOptions);
+    SocketServerResult server = startSocketServer(socketPath, firstConfigURL, serverOptions, [&]() {
+        pipeline->start();
+        pipelineStarted = true;
+        RuntimePrefetcher::instance().start(prefetchOptions, pipelineOptions);
+    });
+    
+    int status = 0;
+    if (pipelineStarted) {
+        pipeline->wait();
+    } else if (server == SOCKET_SERVER_IN_USE) {
+        // Lost the race to another instance starting at the same time
+        if (forwardLaunchRequest(socketPath, urls)) {
+            logWithTimestamp("Handed " + std::to_string(urls.size()) + " config(s) to the running rvm-cpp");
+        } else {
+            logWithTimestamp(LOG_ERROR, "Could not hand the config(s) to the rvm-cpp on " + socketPath);
+            status = 1;
+        }
+    } else {
+        // Applications still start; their runtimes get no replies from this process
+        logWithTimestamp(LOG_ERROR, "Messaging socket unavailable, launching without it");
+        pipeline->start();
+        pipeline->wait();
+        status = 1;
+    }
     
     curl_global_cleanup();
     
-    return 0;
+    return status;
 }
+#endif // RVM_CPP_NO_MAIN
@@ -0,0 +1,282 @@
+// Build a runtime delta package between two extracted runtime trees, for
+// rvm-cpp --delta-updates. Files identical to the base version are referenced, changed
+// files are encoded as copy/add instructions against the base file of the same path
+// (matched rsync-style with a rolling checksum), and new files are stored whole.
+//
+// Usage: ./make_delta <base-dir> <target-dir> <output> [--from=<version>] [--to=<version>]
+//                     [--block-size=1024]
+// Versions default to the directory names. Publish the output as
+// <runtime-base-url>/<arch>/<to>.from-<from>.delta
+#define RVM_CPP_NO_MAIN
+#include "main.cpp"
+
+struct TreeFile {
+    std::string path;
+    uint64_t size;
+    mode_t mode;
+};
+
+// Regular files under root, relative to it, sorted by path
+static void listTree(const std::string& root, const std::string& relative, std::vector<TreeFile>& files) {
+    DIR* dir = opendir((root + "/" + relative).c_str());
+    if (!dir) {
+        throw std::runtime_error("Cannot read directory " + root + "/" + relative);
+    }
+    struct dirent* entry;
+    while ((entry = readdir(dir)) != nullptr) {
+        std::string name = entry->d_name;
+        if (name == "." || name == "..") continue;
+        std::string path = relative.empty() ? name : relative + "/" + name;
+        if (path == INSTALL_INDEX_FILE) continue;
+
+        struct stat st;
+        if (lstat((root + "/" + path).c_str(), &st) != 0) continue;
+        if (S_ISDIR(st.st_mode)) {
+            listTree(root, path, files);
+        } else if (S_ISREG(st.st_mode)) {
+            files.push_back({path, (uint64_t)st.st_size, st.st_mode & 0777});
+        }
+    }
+    closedir(dir);
+    if (relative.empty()) {
+        std::sort(files.begin(), files.end(), [](const TreeFile& a, const TreeFile& b) {
+            return a.path < b.path;
+        });
+    }
+}
+
+static bool readWhole(const std::string& path, std::string& data) {
+    std::ifstream in(path, std::ios::binary);
+    if (!in) return false;
+    data.assign(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+    return true;
+}
+
+static void putU32(std::string& out, uint32_t v) {
+    for (int i = 0; i < 4; i++) out.push_back((char)(v >> (8 * i)));
+}
+
+static void putU64(std::string& out, uint64_t v) {
+    for (int i = 0; i < 8; i++) out.push_back((char)(v >> (8 * i)));
+}
+
+// rsync's weak checksum over a window, updated one byte at a time
+struct RollingSum {
+    uint32_t a = 0;
+    uint32_t b = 0;
+    size_t len = 0;
+
+    void reset(const char* data, size_t n) {
+        a = b = 0;
+        len = n;
+        for (size_t i = 0; i < n; i++) {
+            a += (unsigned char)data[i];
+            b += (uint32_t)(n - i) * (unsigned char)data[i];
+        }
+    }
+
+    void roll(unsigned char out, unsigned char in) {
+        a += in - out;
+        b += a - (uint32_t)len * out;
+    }
+
+    uint32_t value() const { return (b << 16) | (a & 0xffff); }
+};
+
+// Copy/add instructions that turn base into target, ending with DELTA_END
+static std::string encodePatch(const std::string& base, const std::string& target, size_t block) {
+    std::unordered_map<uint32_t, std::vector<uint64_t>> blocks;
+    for (uint64_t offset = 0; offset + block <= base.size(); offset += block) {
+        RollingSum sum;
+        sum.reset(base.data() + offset, block);
+        std::vector<uint64_t>& candidates = blocks[sum.value()];
+        if (candidates.size() < 8) candidates.push_back(offset);
+    }
+
+    std::string out;
+    size_t literalStart = 0;
+    auto flushLiteral = [&](size_t end) {
+        while (literalStart < end) {
+            uint32_t len = (uint32_t)std::min<size_t>(end - literalStart, 1u << 30);
+            out.push_back((char)DELTA_ADD);
+            putU32(out, len);
+            out.append(target, literalStart, len);
+            literalStart += len;
+        }
+    };
+
+    size_t i = 0;
+    RollingSum sum;
+    bool primed = false;
+    while (!blocks.empty() && i + block <= target.size()) {
+        if (!primed) {
+            sum.reset(target.data() + i, block);
+            primed = true;
+        }
+
+        uint64_t matchOffset = 0;
+        bool matched = false;
+        auto it = blocks.find(sum.value());
+        if (it != blocks.end()) {
+            for (uint64_t offset : it->second) {
+                if (memcmp(base.data() + offset, target.data() + i, block) == 0) {
+                    matchOffset = offset;
+                    matched = true;
+                    break;
+                }
+            }
+        }
+
+        if (!matched) {
+            if (i + block < target.size()) {
+                sum.roll(target[i], target[i + block]);
+            }
+            i++;
+            continue;
+        }
+
+        // Grow the match in both directions beyond the block boundaries
+        size_t start = i;
+        uint64_t from = matchOffset;
+        while (start > literalStart && from > 0 && target[start - 1] == base[from - 1]) {
+            start--;
+            from--;
+        }
+        size_t end = i + block;
+        while (end < target.size() && from + (end - start) < base.size() &&
+               target[end] == base[from + (end - start)]) {
+            end++;
+        }
+
+        flushLiteral(start);
+        for (size_t done = start; done < end;) {
+            uint32_t len = (uint32_t)std::min<size_t>(end - done, 1u << 30);
+            out.push_back((char)DELTA_COPY);
+            putU64(out, from + (done - start));
+            putU32(out, len);
+            done += len;
+        }
+        literalStart = end;
+        i = end;
+        primed = false;
+    }
+
+    flushLiteral(target.size());
+    out.push_back((char)DELTA_END);
+    return out;
+}
+
+static std::string directoryName(const std::string& path) {
+    std::string trimmed = path;
+    while (trimmed.size() > 1 && trimmed.back() == '/') trimmed.pop_back();
+    size_t slash = trimmed.find_last_of('/');
+    return slash == std::string::npos ? trimmed : trimmed.substr(slash + 1);
+}
+
+int main(int argc, char* argv[]) {
+    std::vector<std::string> positional;
+    std::string from, to;
+    size_t block = 1024;
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg.find("--from=") == 0) {
+            from = arg.substr(7);
+        } else if (arg.find("--to=") == 0) {
+            to = arg.substr(5);
+        } else if (arg.find("--block-size=") == 0) {
+            block = std::max(16, std::stoi(arg.substr(13)));
+        } else if (arg.find("--") != 0) {
+            positional.push_back(arg);
+        }
+    }
+    if (positional.size() != 3) {
+        std::cerr << "Usage: " << argv[0] << " <base-dir> <target-dir> <output> [--from=<version>] [--to=<version>]"
+                  << " [--block-size=<bytes>]" << std::endl;
+        return 1;
+    }
+    const std::string& baseDir = positional[0];
+    const std::string& targetDir = positional[1];
+    const std::string& output = positional[2];
+    if (from.empty()) from = directoryName(baseDir);
+    if (to.empty()) to = directoryName(targetDir);
+
+    std::vector<TreeFile> files;
+    try {
+        listTree(targetDir, "", files);
+    } catch (const std::exception& e) {
+        std::cerr << "✗ " << e.what() << std::endl;
+        return 1;
+    }
+
+    // Encode everything first: the header has to say how each file is stored
+    json entries = json::array();
+    std::vector<std::string> payloads;
+    uint64_t targetBytes = 0;
+    int unchanged = 0, patched = 0, added = 0;
+    for (const auto& file : files) {
+        std::string target, base;
+        if (!readWhole(targetDir + "/" + file.path, target)) {
+            std::cerr << "✗ Cannot read " << targetDir << "/" << file.path << std::endl;
+            return 1;
+        }
+        targetBytes += target.size();
+        uint32_t crc = (uint32_t)crc32(crc32(0L, Z_NULL, 0), (const Bytef*)target.data(), (uInt)target.size());
+        json entry = {{"path", file.path}, {"size", target.size()}, {"crc32", crc}, {"mode", file.mode}};
+
+        if (readWhole(baseDir + "/" + file.path, base) && base == target) {
+            entry["op"] = "base";
+            unchanged++;
+        } else {
+            std::string patch = base.empty() ? std::string() : encodePatch(base, target, block);
+            if (!patch.empty() && patch.size() < target.size()) {
+                entry["op"] = "patch";
+                payloads.push_back(std::move(patch));
+                patched++;
+            } else {
+                entry["op"] = "data";
+                payloads.push_back(std::move(target));
+                added++;
+            }
+        }
+        entries.push_back(entry);
+    }
+
+    std::string header = json({{"from", from}, {"to", to}, {"files", entries}}).dump();
+    if (header.size() > MAX_DELTA_HEADER_SIZE) {
+        std::cerr << "✗ Delta header of " << header.size() << " bytes is over the " << MAX_DELTA_HEADER_SIZE
+                  << " byte limit" << std::endl;
+        return 1;
+    }
+    std::string preamble(DELTA_MAGIC, sizeof(DELTA_MAGIC));
+    putU32(preamble, DELTA_FORMAT_VERSION);
+    putU32(preamble, (uint32_t)header.size());
+    preamble += header;
+
+    gzFile out = gzopen(output.c_str(), "wb");
+    bool ok = out != nullptr;
+    auto put = [&](const std::string& data) {
+        for (size_t done = 0; ok && done < data.size();) {
+            unsigned len = (unsigned)std::min<size_t>(data.size() - done, 1u << 30);
+            ok = gzwrite(out, data.data() + done, len) == (int)len;
+            done += len;
+        }
+    };
+    put(preamble);
+    for (const auto& payload : payloads) {
+        put(payload);
+    }
+    if (out && gzclose(out) != Z_OK) ok = false;
+    if (!ok) {
+        std::cerr << "✗ Failed to write " << output << std::endl;
+        return 1;
+    }
+
+    struct stat st;
+    stat(output.c_str(), &st);
+    std::cout << from << " -> " << to << ": " << unchanged << " unchanged, " << patched << " patched, "
+              << added << " stored whole" << std::endl;
+    std::cout << "✓ Wrote " << output << ": " << st.st_size << " bytes for " << targetBytes << " bytes of runtime ("
+              << std::fixed << std::setprecision(1) << 100.0 * st.st_size / std::max<uint64_t>(1, targetBytes)
+              << "%)" << std::endl;
+    return 0;
+}